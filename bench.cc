@@ -0,0 +1,289 @@
+//
+// Copyright (c) 2024 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+
+#include "stfu.hh"
+
+//
+// Benchmarks of the framework's own overhead: the cost per (trivial) test of
+// starting, reaping and reporting it, as the number of tests, the size of the
+// parent's heap, the execution mode and the report format vary. Each
+// measurement is written as a line of JSON to the standard output.
+//
+
+namespace {
+
+    using seconds = std::chrono::duration<double>;
+
+    //
+    // A reporter which totals the phases of each test as it concludes, and
+    // passes every event on to the sink being measured.
+    //
+    class timing: public stfu::reporter {
+        public:
+
+        explicit timing(stfu::reporter& s): sink(s) {}
+
+        void group_start(const stfu::test_group& g) override {
+            sink.group_start(g);
+        }
+
+        void test_start(const stfu::test_group& g,
+                        const stfu::test& t) override {
+            sink.test_start(g, t);
+        }
+
+        void test_result(const stfu::test_group& g, const stfu::test& t,
+                         const stfu::test_result_data& r) override {
+            fork += r.phases.fork;
+            reap += r.phases.reap;
+            passed += (stfu::test_result::PASS == r.result) ? 1 : 0;
+            sink.test_result(g, t, r);
+        }
+
+        void error(const stfu::test_group& g,
+                   const std::string& what) override {
+            sink.error(g, what);
+        }
+
+        void summary(const stfu::test_group& g,
+                     const stfu::test_result_summary& s) override {
+            sink.summary(g, s);
+        }
+
+        void flush() override {
+            sink.flush();
+        }
+
+        stfu::reporter& sink;
+        seconds fork{0};
+        seconds reap{0};
+        std::size_t passed = 0;
+    };
+
+    //
+    // One way of running a group's tests.
+    //
+    struct mode {
+        const char* name;
+        stfu::execution_mode exec;
+        std::size_t jobs;       // 0 for one per online CPU
+        bool plain;             // A plain function, run from the zygote
+    };
+
+    const mode modes[] = {
+        { "forked", stfu::execution_mode::FORKED, 1, false },
+        { "in_process", stfu::execution_mode::IN_PROCESS, 1, false },
+        { "batched", stfu::execution_mode::BATCHED, 1, false },
+        { "parallel", stfu::execution_mode::FORKED, 0, false },
+        { "zygote", stfu::execution_mode::FORKED, 1, true },
+    };
+
+    void
+    trivial()
+    {
+        STFU_PASS();
+    }
+
+    //
+    // A reporter of the given format, writing to the given stream; "null"
+    // reports nothing at all.
+    //
+    std::unique_ptr<stfu::reporter>
+    make_sink(const std::string& format, std::ostream& out)
+    {
+        if ("text" == format) {
+            return std::unique_ptr<stfu::reporter>{
+                    new stfu::text_reporter{out}};
+        } else if ("json" == format) {
+            return std::unique_ptr<stfu::reporter>{
+                    new stfu::json_reporter{out}};
+        } else if ("junit" == format) {
+            return std::unique_ptr<stfu::reporter>{
+                    new stfu::junit_reporter{out}};
+        } else if ("tap" == format) {
+            return std::unique_ptr<stfu::reporter>{
+                    new stfu::tap_reporter{out}};
+        }
+
+        return std::unique_ptr<stfu::reporter>{new stfu::reporter};
+    }
+
+    //
+    // Memory held (and touched, so that it's mapped) by the parent while
+    // tests run, as a large program's would be.
+    //
+    class heap {
+        public:
+
+        explicit heap(std::size_t n): bytes(n), block(new char[n]) {
+            std::memset(block.get(), 1, bytes);
+            stfu::do_not_optimize(block.get());
+        }
+
+        std::size_t bytes;
+        std::unique_ptr<char[]> block;
+    };
+
+    //
+    // Run a group of trivial tests in the given mode, reporting to the given
+    // sink (to /dev/null), and write out what it cost.
+    //
+    void
+    measure(const char* sweep, const mode& m, std::size_t count,
+            std::size_t heap_bytes, const std::string& format)
+    {
+        std::vector<stfu::test> tests;
+        tests.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            if (m.plain) {
+                tests.emplace_back("trivial", &trivial);
+            } else {
+                tests.emplace_back("trivial", []{ STFU_PASS(); });
+            }
+        }
+
+        stfu::test_group group{"bench", "Trivial tests, to time STFU."};
+        group.add_tests(std::move(tests), m.exec)
+             .set_jobs(m.jobs)
+             .set_verbose(false);
+
+        std::ofstream devnull{"/dev/null"};
+        const auto sink = make_sink(format, devnull);
+        timing events{*sink};
+
+        const auto t1 = std::chrono::steady_clock::now();
+        group(events);
+        const seconds elapsed = std::chrono::steady_clock::now() - t1;
+
+        const double us = 1e6 / count;
+
+        std::cout << "{\"sweep\":\"" << sweep << "\""
+                  << ",\"mode\":\"" << m.name << "\""
+                  << ",\"sink\":\"" << format << "\""
+                  << ",\"tests\":" << count
+                  << ",\"heap_bytes\":" << heap_bytes
+                  << ",\"jobs\":" << group.get_jobs()
+                  << ",\"passed\":" << events.passed
+                  << ",\"seconds\":" << elapsed.count()
+                  << ",\"per_test_us\":" << elapsed.count() * us
+                  << ",\"fork_us\":" << events.fork.count() * us
+                  << ",\"reap_us\":" << events.reap.count() * us
+                  << "}" << std::endl;
+    }
+
+    //
+    // Parse a size with an optional K, M or G suffix.
+    //
+    std::size_t
+    parse_size(const char* text)
+    {
+        char* end = nullptr;
+        std::size_t n = std::strtoull(text, &end, 10);
+
+        switch (*end) {
+        case 'G':
+            n <<= 10;
+            // Fall through
+        case 'M':
+            n <<= 10;
+            // Fall through
+        case 'K':
+            n <<= 10;
+            break;
+        default:
+            break;
+        }
+
+        return n;
+    }
+}
+
+int
+main(int argc, char* argv[])
+{
+    std::size_t max_tests = 100000;
+    std::size_t max_heap = parse_size("4G");
+    std::size_t fixed_tests = 1000;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg{argv[i]};
+
+        if (arg == "--max-tests" && i + 1 < argc) {
+            max_tests = std::strtoull(argv[++i], nullptr, 10);
+            continue;
+        }
+
+        if (arg == "--max-heap" && i + 1 < argc) {
+            max_heap = parse_size(argv[++i]);
+            continue;
+        }
+
+        if (arg == "--tests" && i + 1 < argc) {
+            fixed_tests = std::strtoull(argv[++i], nullptr, 10);
+            continue;
+        }
+
+        if (arg == "--quick") {
+            max_tests = 1000;
+            max_heap = parse_size("64M");
+            fixed_tests = 100;
+            continue;
+        }
+
+        std::cerr << "Usage: " << argv[0] << " [--quick] [--max-tests N]"
+                  << " [--max-heap SIZE] [--tests N]" << std::endl;
+        return 1;
+    }
+
+    // Started before any heap is held, as a large program should.
+    stfu::start_zygote();
+
+    // Overhead by the number of tests in the group.
+    for (const auto &m: modes) {
+        for (std::size_t n = 10; n <= max_tests; n *= 10) {
+            measure("tests", m, n, 0, "null");
+        }
+    }
+
+    // Overhead by the size of the parent, which each fork() copies the
+    // page tables of.
+    for (std::size_t bytes = parse_size("1M"); bytes <= max_heap;
+         bytes *= 4) {
+        std::unique_ptr<heap> held;
+
+        try {
+            held.reset(new heap{bytes});
+        } catch (const std::bad_alloc&) {
+            std::cerr << "Couldn't allocate a heap of " << bytes
+                      << " bytes" << std::endl;
+            break;
+        }
+
+        for (const auto &m: modes) {
+            measure("heap", m, fixed_tests, held->bytes, "null");
+        }
+    }
+
+    // Overhead by the format of the report.
+    for (const char* format: {"null", "text", "json", "junit", "tap"}) {
+        for (const auto &m: modes) {
+            measure("sink", m, fixed_tests, 0, format);
+        }
+    }
+
+    return 0;
+}
@@ -7,19 +7,85 @@
 
 #pragma once
 
-#include <iostream>
-#include <iomanip>
+//
+// By default STFU is header-only: every source file which includes it
+// compiles all of it, inline. To compile the implementation just once,
+// define STFU_SEPARATE_COMPILATION wherever stfu.hh is included (say, on the
+// compiler's command line, or before it in a precompiled header), which then
+// declares no more than it must, and define STFU_IMPLEMENTATION before
+// including it in exactly one source file, which then defines it all.
+//
+
+#if defined(STFU_IMPLEMENTATION)
+#define STFU_INLINE
+#define STFU_DEFINITIONS 1
+#elif defined(STFU_SEPARATE_COMPILATION)
+#define STFU_DEFINITIONS 0
+#else
+#define STFU_INLINE inline
+#define STFU_DEFINITIONS 1
+#endif
+
+#include <ostream>
 #include <streambuf>
 #include <string>
 #include <functional>
 #include <chrono>
 #include <utility>
 #include <vector>
+#include <map>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <exception>
+#include <new>
+#include <memory>
+#include <typeinfo>
+#include <type_traits>
+#include <sys/types.h>
+
+#if STFU_DEFINITIONS
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
 #include <stdexcept>
+#include <system_error>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <climits>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <thread>
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
 
 #include <unistd.h>
 #include <csignal>
+#include <poll.h>
 #include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <linux/mempolicy.h>
+#include <sys/signalfd.h>
+#endif
+#include <fcntl.h>
+#include <sched.h>
+#endif // STFU_DEFINITIONS
 
 #define STFU_VERSION    "1.0.0"
 
@@ -54,6 +120,82 @@
     { if (!(x)) throw stfu_private::failed_assert{__FILE__, __LINE__, #x}; } \
     while (0)
 
+//
+// Compare two values, and if the comparison doesn't hold, conclude the test
+// routine with a failing result which shows both values, as well as the
+// expressions. Each operand is evaluated once; the values are formatted only
+// on failure.
+//
+#define STFU_ASSERT_EQ(a, b)    STFU_ASSERT_COMPARE(a, ==, b)
+#define STFU_ASSERT_NE(a, b)    STFU_ASSERT_COMPARE(a, !=, b)
+#define STFU_ASSERT_LT(a, b)    STFU_ASSERT_COMPARE(a, <, b)
+#define STFU_ASSERT_LE(a, b)    STFU_ASSERT_COMPARE(a, <=, b)
+#define STFU_ASSERT_GT(a, b)    STFU_ASSERT_COMPARE(a, >, b)
+#define STFU_ASSERT_GE(a, b)    STFU_ASSERT_COMPARE(a, >=, b)
+
+#define STFU_ASSERT_COMPARE(a, op, b) do \
+    { const auto& stfu_a = (a); const auto& stfu_b = (b); \
+      if (!(stfu_a op stfu_b)) \
+          throw stfu_private::failed_compare{__FILE__, __LINE__, \
+                  #a " " #op " " #b, stfu_private::show(stfu_a), \
+                  stfu_private::show(stfu_b)}; } \
+    while (0)
+
+//
+// As above, for two values which must differ by no more than the tolerance
+// (as floating point values seldom compare equal).
+//
+#define STFU_ASSERT_NEAR(a, b, tolerance) do \
+    { const auto& stfu_a = (a); const auto& stfu_b = (b); \
+      const auto& stfu_t = (tolerance); \
+      if (!((stfu_a < stfu_b ? stfu_b - stfu_a : stfu_a - stfu_b) <= stfu_t)) \
+          throw stfu_private::failed_compare{__FILE__, __LINE__, \
+                  #a " near " #b, stfu_private::show(stfu_a), \
+                  stfu_private::show(stfu_b), stfu_private::show(stfu_t)}; } \
+    while (0)
+
+//
+// Fail the test routine if anything allocates from the heap (via operator
+// new) within the block which follows the macro, as counted when allocation
+// counting is enabled; otherwise the assertion itself fails.
+//
+
+#define STFU_ASSERT_NO_ALLOC \
+    for (stfu_private::no_alloc_scope stfu_no_alloc{__FILE__, __LINE__}; \
+         stfu_no_alloc.enter(); )
+
+//
+// Define a test routine, registered as test `name` in group `group` (both
+// identifiers) for stfu::run_main() to run. The body follows the macro, as
+// for a function. Tags, separated by spaces or commas, allow the test to be
+// selected along with others alike.
+//
+#define STFU_TEST(group, name) STFU_TAGGED_TEST(group, name, "")
+
+#define STFU_TAGGED_TEST(group, name, tags) \
+    static void STFU_TEST_ROUTINE(group, name)(); \
+    static const stfu_private::registrar STFU_TEST_REGISTRAR(group, name){ \
+        stfu::registered_test{#group, #name, tags, __FILE__, __LINE__, \
+                              &STFU_TEST_ROUTINE(group, name)}}; \
+    static void STFU_TEST_ROUTINE(group, name)()
+
+#define STFU_TEST_ROUTINE(group, name) stfu_test_##group##_##name
+#define STFU_TEST_REGISTRAR(group, name) stfu_registrar_##group##_##name
+
+struct rusage;
+
+namespace stfu_private {
+    class receiver;
+    class ring;
+    class jobserver;
+    class zygote;
+    struct measure;
+    struct cached;
+
+    using baseline = std::map<std::string, measure>;
+    using history = std::map<std::string, cached>;
+}
+
 namespace stfu {
 
     //
@@ -65,7 +207,83 @@ namespace stfu {
         SKIPPED,
         PASS,
         FAIL,
-        CRASH
+        CRASH,
+        TIMEOUT,
+        SLOW,           // Passed, but over budget or regressed
+        OUT_OF_RESOURCES // Exceeded a resource limit
+    };
+
+    //
+    // Ways in which a test routine may be executed.
+    //
+
+    enum class execution_mode {
+        DEFAULT,        // Tests: as per the group; groups: FORKED
+        FORKED,         // In a child process of its own
+        IN_PROCESS,     // Directly in the calling process; no isolation
+        BATCHED         // In a child process shared with other tests
+    };
+
+    //
+    // Orders in which a group may start its tests.
+    //
+
+    enum class schedule_policy {
+        DECLARED,       // As declared (or selected)
+        LONGEST_FIRST   // By their last runtimes in the cache, descending
+    };
+
+    //
+    // Resources consumed by a test routine, as accounted by the system.
+    //
+
+    struct resource_usage {
+        std::chrono::duration<double> user{};
+        std::chrono::duration<double> system{};
+        long max_rss{0};                // KiB
+        long minor_faults{0};
+        long major_faults{0};
+        long voluntary_switches{0};
+        long involuntary_switches{0};
+    };
+
+    //
+    // Heap allocations made by a test routine, when counted: define
+    // STFU_COUNT_ALLOCATIONS before including this header in exactly one
+    // source file of the program, to replace the global operator new and
+    // delete with counting versions.
+    //
+
+    struct allocation_counts {
+        std::size_t allocations{0};
+        std::size_t deallocations{0};
+        std::size_t bytes{0};           // Total allocated, not just live
+    };
+
+    //
+    // Hardware (and kernel) performance counters of a test routine's body,
+    // when enabled; each is -1 if it couldn't be counted.
+    //
+
+    struct perf_counters {
+        long long cycles{-1};
+        long long instructions{-1};
+        long long cache_references{-1};
+        long long cache_misses{-1};
+        long long branch_misses{-1};
+        long long task_clock{-1};       // Nanoseconds
+    };
+
+    //
+    // Breakdown of the time taken by the phases of running a test.
+    //
+
+    struct phase_times {
+        std::chrono::duration<double> fork{};           // In the parent
+        std::chrono::duration<double> body{};           // Where it ran
+        std::chrono::duration<double> reap{};           // Once concluded
+        std::chrono::duration<double> before_each{};
+        std::chrono::duration<double> after_each{};
     };
 
     //
@@ -76,8 +294,34 @@ namespace stfu {
         test_result result{test_result::DIDNT_RUN};
         std::string message{};
         std::chrono::duration<double> runtime{};
+        resource_usage usage{};
+        phase_times phases{};
+        allocation_counts allocations{};
+        perf_counters counters{};
+
+        // Recorded by the test routine as it ran.
+        std::vector<std::string> notes{};
+        std::vector<std::pair<std::string, double>> metrics{};
+        std::vector<std::pair<std::string, std::string>> annotations{};
+
+        // Captured standard output/error (the last part, if it was longer
+        // than the capture limit), the total size written, and the file it
+        // was written to (if any).
+        std::string output{};
+        std::size_t output_size{0};
+        std::string output_file{};
     };
 
+    //
+    // Record information from within a test routine, to be reported along
+    // with its result: a free-form note, a named numeric metric, or an
+    // arbitrary key/value annotation.
+    //
+
+    void note(const std::string&) noexcept;
+    void metric(const std::string&, double) noexcept;
+    void annotate(const std::string&, const std::string&) noexcept;
+
     //
     // Summary of a set of test results.
     //
@@ -88,6 +332,34 @@ namespace stfu {
         std::size_t passed{0};
         std::size_t failed{0};
         std::size_t crashed{0};
+        std::size_t timed_out{0};
+        std::size_t slow{0};
+        std::size_t out_of_resources{0};
+    };
+
+    //
+    // Where, and how eagerly, a test's child process is scheduled: the CPUs
+    // it may run on, its niceness and real-time (SCHED_FIFO) priority, and
+    // the NUMA node its memory is allocated on. Anything unset is inherited.
+    //
+
+    struct placement {
+        std::vector<int> cpus{};        // Any CPU, if empty
+        int nice{0};                    // Unchanged, if 0
+        int fifo_priority{0};           // Not real-time, if 0
+        int numa_node{-1};              // Any node, if negative
+    };
+
+    //
+    // Resources a test's child process may use; zero means no limit. The
+    // memory limit needs a cgroup (see test_group::set_cgroup()).
+    //
+
+    struct resource_limits {
+        std::size_t address_space{0};           // Bytes of virtual memory
+        std::size_t memory{0};                  // Bytes of memory, resident
+        std::chrono::seconds cpu_time{0};       // Of user and system time
+        std::size_t open_files{0};              // File descriptors
     };
 
     //
@@ -98,40 +370,244 @@ namespace stfu {
         public:
 
         using test_routine = std::function<void()>;
+        using seconds = std::chrono::duration<double>;
 
         test(const char* name,
              test_routine routine,
              const char* description = "") noexcept;
-        ~test();
 
         const std::string& get_name() const noexcept;
         const std::string& get_description() const noexcept;
         bool is_enabled() const noexcept;
+        seconds get_timeout() const noexcept;
+        execution_mode get_mode() const noexcept;
+        seconds get_budget() const noexcept;
+        const placement& get_placement() const noexcept;
+        const resource_limits& get_limits() const noexcept;
 
         test& set_enable(bool) noexcept;
+        test& set_timeout(seconds) noexcept;
+        test& set_mode(execution_mode) noexcept;
+        test& set_budget(seconds) noexcept;
+        test& set_placement(const placement&);
+        test& set_limits(const resource_limits&) noexcept;
 
         test_result_data operator()() const;
 
         protected:
 
+        friend class test_group;
+        friend class stfu_private::zygote;
+
         test_routine fn;
 
-        mutable int filedes[2] = { -1, -1 };
         enum pipe_end {
             read_end = 0,
             write_end = 1
         };
 
+        //
+        // State of one run of a test in a child process: the child's pid,
+        // and the pipe over which it reports. The pipe is closed with it,
+        // so it may be moved but not copied; each run has its own, so the
+        // same test may be run concurrently.
+        //
+        struct execution {
+            pid_t pid = -1;
+            int filedes[2] = { -1, -1 };
+            int relay = -1;             // Exit of a child of the zygote
+            std::string cgroup;         // Of the child, if any
+
+            execution() = default;
+            execution(execution&&) noexcept;
+            execution& operator=(execution&&) noexcept;
+            ~execution();
+
+            void close_handle(pipe_end) noexcept;
+        };
+
         std::string name;
         std::string description;
         bool enabled = true;
+        seconds timeout{0};
+        execution_mode mode = execution_mode::DEFAULT;
+        seconds budget{0};
+        placement place;
+        resource_limits limits;
+
+        using deadline = std::chrono::steady_clock::time_point;
+
+        //
+        // How a group has its tests' routines run, beyond their own
+        // settings.
+        //
+        struct run_settings {
+            bool counters = false;      // Count perf events of the body
+            placement place;            // Of a forked child
+            resource_limits limits;     // Of a forked child
+            std::string cgroup;         // To make the child's cgroup in
+            bool fork_here = false;     // Needs arenas or fixtures' effects
+        };
+
+        execution_mode mode_in(execution_mode) const noexcept;
+        void execute(test_result_data&, const run_settings&) const;
+        test_result_data run_in_process(const run_settings&) const;
+        pid_t spawn(execution&, seconds&, int, const run_settings&) const;
+        [[noreturn]] void run_child(int, int, const run_settings&) const;
+        test_result_data reap(execution&, deadline,
+                              stfu_private::receiver&) const noexcept;
+        deadline deadline_for(seconds) const noexcept;
+    };
+
+    //
+    // A test which measures its routine, run repeatedly in a loop, instead of
+    // concluding it: after warming up, either a fixed number of iterations
+    // or as many as fit in a time budget are timed in batches, and the time
+    // per iteration reported as metrics. A benchmark passes once measured,
+    // unless its routine fails or crashes.
+    //
+
+    class benchmark: public test {
+        public:
+
+        benchmark(const char* name,
+                  test_routine routine,
+                  const char* description = "");
+
+        benchmark& set_warmup(std::size_t);
+        benchmark& set_iterations(std::size_t);
+        benchmark& set_time_budget(seconds);
+
+        protected:
+
+        test_routine body;
+        std::size_t warmup = 10;
+        std::size_t iterations = 0;     // 0: as many as fit in the budget
+        seconds budget{0.5};
+
+        void rebind();
+
+        static void measure(const test_routine&, std::size_t, std::size_t,
+                            seconds);
+    };
+
+    //
+    // A test which runs its routine on several threads at once, to provoke
+    // races: the threads start together, released by a barrier, and each
+    // calls the routine (with its thread index) for a number of iterations
+    // or until a time budget is spent. The test fails as soon as any thread
+    // fails, and passes once every thread is done, reporting each thread's
+    // throughput as metrics. Like any test it runs in a child process, so a
+    // crash is contained.
+    //
+
+    class stress: public test {
+        public:
 
-        void write_result(test_result) const noexcept;
-        void write_result(test_result, const std::string&) const noexcept;
-        test_result_data read_result() const noexcept;
-        void close_handle(pipe_end) const noexcept;
+        using stress_routine = std::function<void(std::size_t)>;
+
+        stress(const char* name,
+               stress_routine routine,
+               const char* description = "");
+
+        stress& set_threads(std::size_t);
+        stress& set_iterations(std::size_t);
+        stress& set_time_budget(seconds);
+
+        protected:
+
+        stress_routine body;
+        std::size_t threads = 0;        // 0: one per online CPU
+        std::size_t iterations = 0;     // 0: as many as fit in the budget
+        seconds budget{0.5};
+
+        void rebind();
+
+        static void run(const stress_routine&, std::size_t, std::size_t,
+                        seconds);
+    };
+
+    //
+    // Prevent the compiler from optimizing away the computation of a value,
+    // or from assuming memory is unchanged across a point, when benchmarking.
+    //
+
+    template <typename T>
+    void do_not_optimize(const T&) noexcept;
+    void clobber() noexcept;
+
+    //
+    // Generate a test case per value in a container (named by its index, as
+    // "name[3]"), or per type in a list (named by the type, as "name<int>"),
+    // from one routine: either a callable taking the value, or one with a
+    // member template operator()<T>() taking no arguments. Cases are added
+    // to a group with add_tests(), and may be batched to run in shared
+    // children instead of a fork per case.
+    //
+
+    template <typename Container, typename Routine>
+    std::vector<test> parameterized(const char* name, const Container&,
+                                    Routine, const char* description = "");
+
+    template <typename... Types, typename Routine>
+    std::vector<test> typed(const char* name, Routine,
+                            const char* description = "");
+
+    //
+    // Memory set up once for a group, and shared with the children running
+    // its tests instead of being rebuilt (or copied on write) in each: a
+    // read-only section, filled in by a setup routine before any test runs,
+    // and optionally a writable section in which children may publish
+    // counters or results back to the parent. Either may be huge pages, and
+    // the read-only section may be backed by a file. An arena is mapped as
+    // a group that uses it first runs, and unmapped when destroyed, so it
+    // must outlive the group's runs.
+    //
+
+    class arena {
+        public:
+
+        using setup_routine = std::function<void(void*, std::size_t)>;
+
+        arena(const char* name, std::size_t size,
+              setup_routine setup = nullptr) noexcept;
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+        ~arena();
+
+        arena& set_shared_size(std::size_t) noexcept;
+        arena& set_huge_pages(bool) noexcept;
+        arena& set_file(const std::string&);
+
+        const std::string& get_name() const noexcept;
+        const void* data() const noexcept;
+        std::size_t size() const noexcept;
+        void* shared() const noexcept;
+        std::size_t shared_size() const noexcept;
+
+        protected:
+
+        friend class test_group;
+
+        std::string name;
+        std::size_t length;
+        setup_routine setup;
+        std::size_t shared_length = 0;
+        bool huge_pages = false;
+        std::string file;
+
+        // Mappings, once set up.
+        void* region = nullptr;
+        std::size_t region_size = 0;
+        void* section = nullptr;
+        std::size_t section_size = 0;
+
+        bool map();
+        void unmap() noexcept;
     };
 
+    class reporter;
+
     //
     // Group of related tests.
     //
@@ -141,32 +617,356 @@ namespace stfu {
 
         using fixture = std::function<bool()>;
 
-        explicit test_group(const char* name,
-                            const char* description = "") noexcept;
+        explicit test_group(const char* name, const char* description = "");
 
         test_group& set_verbose(bool) noexcept;
+        test_group& set_jobs(std::size_t) noexcept;
+        test_group& set_timeout(test::seconds) noexcept;
+        test_group& set_mode(execution_mode) noexcept;
+        test_group& set_capture(bool) noexcept;
+        test_group& set_capture_limit(std::size_t) noexcept;
+        test_group& set_capture_dir(const std::string&);
+        test_group& set_usage(bool) noexcept;
+        test_group& set_phases(bool) noexcept;
+        test_group& set_counters(bool) noexcept;
+        test_group& set_placement(const placement&);
+        test_group& set_spread(bool) noexcept;
+        test_group& set_limits(const resource_limits&) noexcept;
+        test_group& set_cgroup(const std::string&);
+        test_group& set_budget(test::seconds) noexcept;
+        test_group& set_baseline(const std::string&);
+        test_group& set_update_baseline(bool) noexcept;
+        test_group& set_regression_ratio(double) noexcept;
+        test_group& set_regression_slack(test::seconds) noexcept;
+        test_group& set_shard(std::size_t, std::size_t) noexcept;
+        test_group& set_fail_fast(std::size_t = 1) noexcept;
+        test_group& set_shard_weights(const std::string&);
+        test_group& set_cache(const std::string&);
+        test_group& set_failed_first(bool) noexcept;
+        test_group& set_only_failed(bool) noexcept;
+        test_group& set_schedule(schedule_policy) noexcept;
+        test_group& apply_environment();
+        test_group& add_arena(arena&);
         test_group& add_test(const test&);
+        test_group& add_test(test&&);
+        test_group& add_tests(std::vector<test>&&,
+                              execution_mode = execution_mode::DEFAULT);
+        template <typename... Args>
+        test_group& emplace_test(Args&&...);
+
+        const std::string& get_name() const noexcept;
+        const std::string& get_description() const noexcept;
+        std::size_t get_test_count() const noexcept;
+        std::size_t get_jobs() const noexcept;
+        test::seconds get_timeout() const noexcept;
+        execution_mode get_mode() const noexcept;
 
         test_group& add_before_all(const fixture&);
         test_group& add_before_each(const fixture&);
         test_group& add_after_all(const fixture&);
         test_group& add_after_each(const fixture&);
 
-        test_result_summary operator()(std::ostream& = std::cout) const;
+        test_result_summary operator()() const;
+        test_result_summary operator()(std::ostream&) const;
+        test_result_summary operator()(reporter&) const;
 
         protected:
 
+        friend class text_reporter;
+        friend class test_suite;
+
         std::vector<fixture> before_all;
         std::vector<fixture> before_each;
         std::vector<fixture> after_all;
         std::vector<fixture> after_each;
 
         std::vector<test> tests;
+        std::vector<arena*> arenas;
 
         std::string name;
         std::string description;
         bool verbose = true;
+        std::size_t jobs = 1;
+        test::seconds timeout{0};
+        execution_mode mode = execution_mode::DEFAULT;
+        bool capture = false;
+        std::size_t capture_limit = 65536;
+        std::string capture_dir;
+        bool usage = false;
+        bool phases = false;
+        bool counters = false;
+        placement place;
+        bool spread = false;
+        resource_limits limits;
+        std::string cgroup;
+        test::seconds budget{0};
+        std::string baseline;
+        bool update_baseline = false;
+        double regression_ratio = 1.5;
+        test::seconds regression_slack{0.001};
+        std::size_t shard_index = 0;
+        std::size_t shard_count = 1;
+        std::string shard_weights;
+        std::size_t max_failures = 0;
+        std::string cache;
+        bool failed_first = false;
+        bool only_failed = false;
+        schedule_policy policy = schedule_policy::DECLARED;
+
+        // Tokens for the tests run beyond the first, when run in a suite.
+        const stfu_private::jobserver* tokens = nullptr;
+
+        //
+        // A child process which runs batched tests on command, reporting
+        // the result of each in turn.
+        //
+        struct worker {
+            pid_t pid;
+            int channel;
+            int output;
+            bool busy;
+
+            // Usage of the worker as of the last test it concluded.
+            resource_usage used;
+        };
+
+        void run_fixtures(const std::vector<fixture>&, const char*) const;
+        test::run_settings settings_for(const test&) const;
+        std::vector<int> spread_cpus() const;
+        std::vector<std::size_t> shard() const;
+        std::vector<std::size_t> select(const stfu_private::history&) const;
+        std::vector<std::size_t> schedule(const std::vector<std::size_t>&,
+                                          const stfu_private::history&) const;
+        void judge(const test&, test_result_data&,
+                   const stfu_private::baseline&) const;
+
+        std::string capture_path(const test&) const;
+        int open_capture(const test&) const;
+        test_result_data run_captured(const test&) const;
+        void finish_capture(const test&, stfu_private::ring&,
+                            test_result_data&) const;
+
+        std::size_t dispatch(std::vector<worker>&, std::size_t,
+                             test::seconds&) const;
+        bool start_worker(std::vector<worker>&, std::size_t,
+                          test::seconds&) const;
+        [[noreturn]] void serve(int, const std::vector<std::string>&) const;
+        void stop_worker(worker&) const noexcept;
+        bool collect(worker&, bool, test::deadline,
+                     stfu_private::receiver&) const;
+    };
+
+    //
+    // Receives the events of running test groups, as they happen, to report
+    // them. Results are reported in the order the tests were declared, each
+    // as soon as it and those before it have concluded.
+    //
+
+    class reporter {
+        public:
+
+        virtual ~reporter() = default;
+
+        virtual void group_start(const test_group&) {}
+        virtual void test_start(const test_group&, const test&) {}
+        virtual void test_result(const test_group&, const test&,
+                                 const test_result_data&) {}
+        virtual void error(const test_group&, const std::string&) {}
+        virtual void summary(const test_group&,
+                             const test_result_summary&) {}
+
+        // Write out anything buffered; the group calls this before doing
+        // anything which could take down the process.
+        virtual void flush() {}
+    };
+
+    //
+    // A reporter which writes to an output stream. By default, the stream
+    // is flushed after each event; with a flush interval, results are
+    // flushed in batches, at most that long apart (though errors and
+    // summaries are always flushed at once).
+    //
+
+    class stream_reporter: public reporter {
+        public:
+
+        explicit stream_reporter(std::ostream&) noexcept;
+
+        stream_reporter& set_flush_interval(test::seconds) noexcept;
+
+        void flush() override;
+
+        protected:
+
+        std::ostream& out;
+        test::seconds flush_interval{0};
+        std::chrono::steady_clock::time_point flushed;
+
+        void wrote();
+    };
+
+    //
+    // The default, human-readable report: one line per result, with any
+    // further information as comments.
+    //
+
+    class text_reporter: public stream_reporter {
+        public:
+
+        explicit text_reporter(std::ostream&) noexcept;
+
+        void group_start(const test_group&) override;
+        void test_result(const test_group&, const test&,
+                         const test_result_data&) override;
+        void error(const test_group&, const std::string&) override;
+        void summary(const test_group&, const test_result_summary&) override;
+    };
+
+    //
+    // One JSON object per line for each event.
+    //
+
+    class json_reporter: public stream_reporter {
+        public:
+
+        explicit json_reporter(std::ostream&) noexcept;
+
+        void group_start(const test_group&) override;
+        void test_start(const test_group&, const test&) override;
+        void test_result(const test_group&, const test&,
+                         const test_result_data&) override;
+        void error(const test_group&, const std::string&) override;
+        void summary(const test_group&, const test_result_summary&) override;
+    };
+
+    //
+    // JUnit XML, with a testsuite per group. The document is completed when
+    // the reporter is destroyed.
+    //
+
+    class junit_reporter: public stream_reporter {
+        public:
+
+        explicit junit_reporter(std::ostream&);
+        ~junit_reporter();
+
+        void group_start(const test_group&) override;
+        void test_result(const test_group&, const test&,
+                         const test_result_data&) override;
+        void error(const test_group&, const std::string&) override;
+        void summary(const test_group&, const test_result_summary&) override;
+    };
+
+    //
+    // Test Anything Protocol (version 13), numbering tests across all groups.
+    // The plan follows the tests, once the reporter is destroyed.
+    //
+
+    class tap_reporter: public stream_reporter {
+        public:
+
+        explicit tap_reporter(std::ostream&);
+        ~tap_reporter();
+
+        void group_start(const test_group&) override;
+        void test_result(const test_group&, const test&,
+                         const test_result_data&) override;
+        void error(const test_group&, const std::string&) override;
+
+        protected:
+
+        std::size_t count = 0;
     };
+
+    //
+    // Groups run concurrently, each in a process of its own, sharing one
+    // budget of jobs: every running test takes a job, whichever group it's
+    // in (within its group's own job count). Each group's report is buffered
+    // and written out whole once the group finishes, so reports don't
+    // interleave; they appear in the order the groups finish.
+    //
+
+    class test_suite {
+        public:
+
+        using reporter_factory =
+                std::function<std::unique_ptr<reporter>(std::ostream&)>;
+
+        test_suite() noexcept;
+
+        test_suite& set_jobs(std::size_t) noexcept;
+        test_suite& set_reporter(reporter_factory);
+        test_suite& add_group(const test_group&);
+        test_suite& add_group(test_group&&);
+
+        std::size_t get_jobs() const noexcept;
+        std::size_t get_group_count() const noexcept;
+
+        test_result_summary operator()() const;
+        test_result_summary operator()(std::ostream&) const;
+
+        protected:
+
+        std::vector<test_group> groups;
+        std::size_t jobs = 0;
+        reporter_factory factory;
+    };
+
+    //
+    // The exit status for main() of the given results: 0 if no test failed
+    // (crashed, timed out or ran slow), else 1.
+    //
+
+    int exit_status(const test_result_summary&) noexcept;
+
+    //
+    // A test defined by STFU_TEST(), as registered before main() is run. No
+    // test or group is constructed until it's chosen to run.
+    //
+
+    struct registered_test {
+        const char* group;
+        const char* name;
+        const char* tags;
+        const char* file;
+        int line;
+        void (*routine)();
+    };
+
+    std::vector<registered_test>& registry() noexcept;
+
+    //
+    // Start a zygote: a lean server process, forked as early as possible
+    // (before the program builds up heavy state), from which the children
+    // running tests whose routines are plain functions (such as registered
+    // tests) are forked instead, as they're cheaper to fork. Those tests see
+    // the program as it was when the zygote started: nothing it changes
+    // afterwards, unless their group has arenas or before_all or before_each
+    // fixtures, whose tests are still forked from the program. Returns
+    // whether it's running; it lasts until stopped or the program exits.
+    //
+
+    bool start_zygote();
+    void stop_zygote() noexcept;
+
+    //
+    // Leave (or no longer leave) the whole pages of a region of memory out
+    // of the children forked to run tests, so that forking needn't copy them.
+    // A child which touches the region crashes. Returns whether it's done.
+    //
+
+    bool exclude_from_fork(const void*, std::size_t) noexcept;
+    bool include_in_fork(const void*, std::size_t) noexcept;
+
+    //
+    // Run the registered tests (by group, in order of registration), as
+    // selected by the command line, reporting to the given stream (or the
+    // standard output). Returns the exit status for main(): 0 if no test
+    // failed, else 1.
+    //
+
+    int run_main(int, const char* const*);
+    int run_main(int, const char* const*, std::ostream&);
 }
 
 namespace stfu_private {
@@ -222,485 +1022,6378 @@ namespace stfu_private {
     };
 
     //
-    // A class used to handle failures in fixtures supporting test routines.
+    // A failed assertion comparing two values, showing what they were (and
+    // the tolerance of the comparison, if any).
     //
 
-    class fixture_exception: public std::runtime_error {
+    class failed_compare: public failed_assert {
         public:
 
-        explicit fixture_exception(const char *);
+        failed_compare(const char*, size_t, const char*, const std::string&,
+                       const std::string&, const std::string& = "") noexcept;
     };
 
-    class widthbuf: public std::streambuf {
-        public:
-
-        widthbuf(size_t w, std::streambuf* s);
+    //
+    // Format a value for a failure message: with its operator<<, if it has
+    // one, or else by its size. Values of all types are formatted by the
+    // given function of the stream to format them into.
+    //
 
-        protected:
+    template <typename T>
+    class printable {
+        template <typename U>
+        static auto test(int) -> decltype(std::declval<std::ostream&>() <<
+                                          std::declval<const U&>(),
+                                          std::true_type{});
+        template <typename>
+        static std::false_type test(...);
 
-        typedef std::basic_string<char_type> string;
+        public:
 
-        static const size_t tab_width = 8;
-        const std::string prefix = "#   ";
+        static const bool value = decltype(test<T>(0))::value;
+    };
 
-        size_t width;
-        size_t count;
+    template <typename T>
+    typename std::enable_if<printable<T>::value>::type
+    print_value(std::ostream&, const void*);
+    template <typename T>
+    typename std::enable_if<!printable<T>::value>::type
+    print_value(std::ostream&, const void*);
 
-        std::streambuf* sbuf;
-        string buffer;
+    template <typename T>
+    std::string show(const T&);
+    std::string show(std::nullptr_t);
+    std::string format(void (*)(std::ostream&, const void*), const void*);
 
-        int_type overflow(int_type c) override;
-    };
+    //
+    // A class used to handle failures in fixtures supporting test routines.
+    //
 
-    class widthstream: public std::ostream {
+    class fixture_exception: public std::runtime_error {
         public:
 
-        widthstream(size_t width, std::ostream &os);
+        explicit fixture_exception(const char *);
+    };
+
+    //
+    // Read a numeric setting from the environment, if present and valid.
+    //
+
+    bool getenv(const char*, unsigned long&) noexcept;
+    bool getenv(const char*, double&) noexcept;
+
+    //
+    // Global allocation counts, kept by the replacement operator new and
+    // delete (if enabled), and whether they're enabled.
+    //
+
+    std::atomic<std::size_t>* allocation_counters() noexcept;
+    std::atomic<bool>& counting_allocations() noexcept;
+    stfu::allocation_counts allocations_now() noexcept;
+    stfu::allocation_counts allocations_since(const stfu::allocation_counts&,
+                                              const stfu::allocation_counts&)
+                                              noexcept;
+    void* allocate(std::size_t) noexcept;
+    void deallocate(void*) noexcept;
+
+    //
+    // Place the calling process as given, returning a note of each part
+    // which couldn't be applied; and the CPUs it's allowed to run on.
+    //
+
+    std::vector<std::string> place(const stfu::placement&);
+    std::vector<int> allowed_cpus();
+
+    //
+    // Limit the resources of the calling process as given, within a cgroup
+    // of its own under the given one (if any), returning a note of each limit
+    // which couldn't be applied. The cgroup of a child is named for its pid,
+    // and released (telling whether it ran out of memory) once it's reaped.
+    //
+
+    std::vector<std::string> limit(const stfu::resource_limits&,
+                                   const std::string&);
+    std::string cgroup_of(const std::string&, pid_t);
+    bool release_cgroup(const std::string&) noexcept;
+
+    //
+    // Apply madvise() advice to the whole pages within a region, and only
+    // those, since other data may share the pages at its ends. Returns false
+    // if there are none, or the advice can't be applied.
+    //
+
+    bool advise_pages(const void*, std::size_t, int) noexcept;
+
+    //
+    // The zygote of the program, if started: a server process which forks a
+    // child to run a test routine (a plain function) on request, passing it
+    // the pipe for its results, the pipe to relay its exit over (its wait
+    // status and usage, once the zygote has reaped it) and the descriptor for
+    // its output. The program kills it, if need be, as it would its own.
+    //
+
+    class zygote {
+        public:
+
+        static zygote& instance() noexcept;
+
+        bool start();
+        void stop() noexcept;
+        bool available() const noexcept;
+        pid_t spawn(void (*)(), const stfu::test::run_settings&, int, int,
+                    int);
+
+        protected:
+
+        pid_t pid = -1;
+        pid_t owner = -1;       // The process which may make requests
+        int channel = -1;
+
+        [[noreturn]] void serve();
+        static std::string encode(const stfu::test::run_settings&);
+        static stfu::test::run_settings decode(const std::string&);
+    };
+
+    //
+    // Performance counters of the calling thread (and the threads it starts)
+    // while started, when enabled and permitted; those the system doesn't
+    // support or allow are left uncounted.
+    //
+
+    class perf_events {
+        public:
+
+        explicit perf_events(bool) noexcept;
+        perf_events(const perf_events&) = delete;
+        perf_events& operator=(const perf_events&) = delete;
+        ~perf_events();
+
+        void start() noexcept;
+        void stop(stfu::perf_counters&) noexcept;
+
+        protected:
+
+        static const std::size_t count = 6;
+        int fds[count];
+    };
+
+    //
+    // The scope of an STFU_ASSERT_NO_ALLOC block: entered once, and checked
+    // for allocations as it's left.
+    //
+
+    class no_alloc_scope {
+        public:
+
+        no_alloc_scope(const char*, std::size_t) noexcept;
+
+        bool enter();
+
+        protected:
+
+        const char* file;
+        std::size_t line;
+        bool entered = false;
+        std::size_t before = 0;
+    };
+
+    //
+    // A budget of jobs shared between processes, as tokens in a pipe (as
+    // does make): a job may start once it takes a token, and returns it
+    // when done.
+    //
+
+    class jobserver {
+        public:
+
+        explicit jobserver(std::size_t);
+        jobserver(const jobserver&) = delete;
+        jobserver& operator=(const jobserver&) = delete;
+        ~jobserver();
+
+        bool valid() const noexcept;
+        bool acquire() const noexcept;
+        void release() const noexcept;
+        int fd() const noexcept;
+
+        protected:
+
+        int filedes[2] = { -1, -1 };
+    };
+
+    //
+    // Milliseconds until a deadline, suitable for poll(); -1 if none.
+    //
+
+    int poll_timeout(std::chrono::steady_clock::time_point) noexcept;
+
+    //
+    // Wait for a child process to terminate, killing it if it's still
+    // running at the deadline.
+    //
+
+    pid_t wait(pid_t, int&, std::chrono::steady_clock::time_point,
+               bool&, rusage* = nullptr) noexcept;
+
+    //
+    // Likewise, for a child of the zygote, which relays its wait status and
+    // usage over the given descriptor.
+    //
+
+    pid_t wait_relayed(int, pid_t, int&,
+                       std::chrono::steady_clock::time_point, bool&,
+                       rusage* = nullptr) noexcept;
+
+    //
+    // Resource usage of the calling process, and the usage between two
+    // such measurements (the later maximum RSS being the high-water mark).
+    //
+
+    stfu::resource_usage usage_of(const rusage&) noexcept;
+    stfu::resource_usage usage_self() noexcept;
+    stfu::resource_usage usage_since(const stfu::resource_usage&,
+                                     const stfu::resource_usage&) noexcept;
+
+    //
+    // Describe a child which terminated by signal as a CRASH.
+    //
+
+    void describe_signal(int, stfu::test_result_data&);
+
+    //
+    // Transfer an entire buffer over a file descriptor, retrying short or
+    // interrupted transfers.
+    //
+
+    bool read_all(int, void*, std::size_t) noexcept;
+    bool write_all(int, const void*, std::size_t) noexcept;
+
+    //
+    // Test routines report back to the runner through a stream of framed
+    // records, each of which is a one-byte type, a four-byte payload length
+    // (in native byte order, as both ends are on the same host) and then
+    // the payload. A test's RESULT record is always its last.
+    //
+
+    enum class record: unsigned char {
+        RESULT,         // Result code byte, then the message
+        NOTE,           // Free-form text
+        METRIC,         // Value as a native double, then the name
+        ANNOTATION,     // Key, NUL, then the value
+        USAGE,          // Native resource_usage of a batch worker
+        TIMING,         // Body time, in seconds, as a native double
+        ALLOCATIONS,    // Native allocation_counts of the test routine
+        COUNTERS        // Native perf_counters of the test routine
+    };
+
+    //
+    // Where records from the running test routine are directed: to a file
+    // descriptor when in a child process, else directly to the result data.
+    //
+
+    struct sink {
+        int fd;
+        stfu::test_result_data* local;
+    };
+
+    sink& current_sink() noexcept;
+
+    //
+    // Scoped redirection of the current sink.
+    //
+
+    class redirect {
+        public:
+
+        explicit redirect(int) noexcept;
+        explicit redirect(stfu::test_result_data&) noexcept;
+        ~redirect();
+
+        redirect(const redirect&) = delete;
+        redirect& operator=(const redirect&) = delete;
+
+        protected:
+
+        sink saved;
+    };
+
+    void emit(record, const std::string&) noexcept;
+    bool send(int, record, const std::string&) noexcept;
+    bool send_result(int, const stfu::test_result_data&) noexcept;
+    bool apply(record, const std::string&, stfu::test_result_data&);
+
+    //
+    // Accumulates the records received from a test routine.
+    //
+
+    class receiver {
+        public:
+
+        bool receive(int) noexcept;
+        void drain(int) noexcept;
+        bool concluded() const noexcept;
+        bool corrupted() const noexcept;
+
+        stfu::test_result_data data;
+
+        protected:
+
+        std::string buffer;
+        bool done = false;
+        bool corrupt = false;   // Received a malformed result
+    };
+
+    //
+    // Retains the last so many bytes written to it.
+    //
+
+    class ring {
+        public:
+
+        explicit ring(std::size_t = 0);
+
+        void append(const char*, std::size_t);
+        bool receive(int) noexcept;
+        void drain(int) noexcept;
+
+        std::string str() const;
+        std::size_t size() const noexcept;
+
+        protected:
+
+        std::string buffer;
+        std::size_t limit;
+        std::size_t total = 0;
+
+        friend void read_tail(int, ring&) noexcept;
+    };
+
+    //
+    // Scoped redirection of standard output and error to a file descriptor.
+    //
+
+    class stdio_redirect {
+        public:
+
+        explicit stdio_redirect(int) noexcept;
+        ~stdio_redirect();
+
+        stdio_redirect(const stdio_redirect&) = delete;
+        stdio_redirect& operator=(const stdio_redirect&) = delete;
+
+        protected:
+
+        int saved[2];
+    };
+
+    void flush_stdio() noexcept;
+    void read_tail(int, ring&) noexcept;
+
+    //
+    // Name of a result, and quoting of text for the structured reporters.
+    //
+
+    const char* result_name(stfu::test_result) noexcept;
+    std::string json_quote(const std::string&);
+    std::string xml_quote(const std::string&);
+
+    //
+    // Adds a test to the registry, upon construction.
+    //
+
+    struct registrar {
+        explicit registrar(const stfu::registered_test&);
+    };
+
+    //
+    // Whether the text matches a shell-style pattern of "*" (any run of
+    // characters) and "?" (any one character), and whether a list of tags
+    // includes one.
+    //
+
+    bool glob_match(const char*, const char*) noexcept;
+    bool has_tag(const char*, const std::string&);
+
+    //
+    // A hash of a string which is the same on every machine and every run.
+    //
+
+    std::uint64_t stable_hash(const std::string&) noexcept;
+
+    //
+    // The top-level fields of a JSON object (such as a line written by the
+    // JSON reporter), with strings unquoted, and objects and arrays left
+    // out; and the runtimes of a group's tests from such a report.
+    //
+
+    bool json_fields(const std::string&, std::map<std::string, std::string>&);
+    std::map<std::string, double> load_runtimes(const std::string&,
+                                                const std::string&);
+
+    //
+    // The figure by which a test's performance is compared across runs: a
+    // benchmark's time per iteration, else the time in its body.
+    //
+
+    struct measure {
+        double value;
+        std::string unit;
+    };
+
+    measure measure_of(const stfu::test_result_data&);
+
+    //
+    // Measures of a group's tests from a previous run (a baseline), as kept
+    // in a file: one line per test, of group, test, value and unit, each
+    // separated by a tab.
+    //
+
+    baseline load_baseline(const std::string&, const std::string&);
+    bool save_baseline(const std::string&, const std::string&,
+                       const baseline&);
+
+    //
+    // The last result of each of a group's tests, and its runtime, as kept
+    // in a cache file: one line per test, of group, test, binary key, result
+    // and runtime, each separated by a tab. The key identifies the content
+    // of the executable which produced the result.
+    //
+
+    struct cached {
+        std::string key;
+        std::string result;
+        double runtime;
+
+        bool passed() const;
+        bool failed() const;
+    };
+
+    const std::string& binary_key();
+    history load_history(const std::string&, const std::string&);
+    bool save_history(const std::string&, const std::string&,
+                      const history&);
+
+    //
+    // Replace the lines of a group in a file of tab-separated fields led by
+    // the group name, keeping those of other groups. The file is replaced
+    // atomically.
+    //
+
+    bool save_group(const std::string&, const std::string&,
+                    const std::string&);
+
+    //
+    // Readable name of a type, for naming typed test cases, and of a mangled
+    // name.
+    //
+
+    template <typename T>
+    std::string type_name();
+    std::string demangle(const char*);
+
+    template <typename Routine>
+    void add_typed(std::vector<stfu::test>&, const std::string&,
+                   const Routine&, const char*);
+    template <typename Routine, typename T, typename... Types>
+    void add_typed(std::vector<stfu::test>&, const std::string&,
+                   const Routine&, const char*);
+
+    class widthbuf: public std::streambuf {
+        public:
+
+        widthbuf(size_t w, std::streambuf* s);
+        ~widthbuf();
+
+        protected:
+
+        typedef std::basic_string<char_type> string;
+
+        static const size_t tab_width = 8;
+        const std::string prefix = "#   ";
+
+        size_t width;
+        size_t count;
+
+        std::streambuf* sbuf;
+        string buffer;          // The line being wrapped
+        string pending;         // Wrapped output, yet to go to sbuf
+
+        char_type area[512];
+
+        void wrap(char_type c);
+        void drain();
+
+        int_type overflow(int_type c) override;
+        int sync() override;
+    };
+
+    class widthstream: public std::ostream {
+        public:
+
+        widthstream(size_t width, std::ostream &os);
 
         protected:
 
-        widthbuf buf;
+        widthbuf buf;
+    };
+}
+
+//
+// Template implementations, which every translation unit compiles.
+//
+
+template <typename T>
+inline void
+stfu::do_not_optimize(const T& value) noexcept
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static const void* volatile escape;
+    escape = &value;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+template <typename Container, typename Routine>
+inline std::vector<stfu::test>
+stfu::parameterized(const char* name, const Container& values,
+                    Routine routine, const char* description)
+{
+    std::vector<test> cases;
+    std::size_t i = 0;
+
+    for (const auto &value: values) {
+        const std::string case_name = std::string{name} + "[" +
+                                      std::to_string(i++) + "]";
+        cases.emplace_back(case_name.c_str(),
+                           std::bind(routine, value), description);
+    }
+
+    return cases;
+}
+
+template <typename... Types, typename Routine>
+inline std::vector<stfu::test>
+stfu::typed(const char* name, Routine routine, const char* description)
+{
+    std::vector<test> cases;
+
+    stfu_private::add_typed<Routine, Types...>(cases, name, routine,
+                                               description);
+    return cases;
+}
+
+//
+// Add a test constructed in place from the given arguments.
+//
+template <typename... Args>
+inline stfu::test_group&
+stfu::test_group::emplace_test(Args&&... args)
+{
+    tests.emplace_back(std::forward<Args>(args)...);
+    return *this;
+}
+
+template <typename T>
+inline std::string
+stfu_private::type_name()
+{
+    return demangle(typeid(T).name());
+}
+
+template <typename T>
+inline typename std::enable_if<stfu_private::printable<T>::value>::type
+stfu_private::print_value(std::ostream& out, const void* value)
+{
+    out << *static_cast<const T*>(value);
+}
+
+template <typename T>
+inline typename std::enable_if<!stfu_private::printable<T>::value>::type
+stfu_private::print_value(std::ostream& out, const void*)
+{
+    out << "(" << sizeof(T) << "-byte object)";
+}
+
+template <typename T>
+inline std::string
+stfu_private::show(const T& value)
+{
+    return format(&print_value<T>, &value);
+}
+
+template <typename Routine>
+inline void
+stfu_private::add_typed(std::vector<stfu::test>&, const std::string&,
+                        const Routine&, const char*)
+{
+}
+
+template <typename Routine, typename T, typename... Types>
+inline void
+stfu_private::add_typed(std::vector<stfu::test>& cases,
+                        const std::string& name, const Routine& routine,
+                        const char* description)
+{
+    const std::string case_name = name + "<" + type_name<T>() + ">";
+
+    cases.emplace_back(case_name.c_str(),
+                       [routine]{ routine.template operator()<T>(); },
+                       description);
+    add_typed<Routine, Types...>(cases, name, routine, description);
+}
+
+#if STFU_DEFINITIONS
+
+//
+// Pretty-print the output of a test result.
+//
+
+STFU_INLINE std::ostream&
+operator<<(std::ostream& out, const stfu::test_result_data& d)
+{
+    switch (d.result) {
+    case stfu::test_result::DIDNT_RUN:
+        out << "\aDIDNT_RUN";
+        break;
+
+    case stfu::test_result::SKIPPED:
+        out << "SKIPPED";
+        break;
+
+    case stfu::test_result::PASS:
+        out << "PASS";
+        break;
+
+    case stfu::test_result::FAIL:
+        out << "\aFAIL";
+        break;
+
+    case stfu::test_result::CRASH:
+        out << "\aCRASH";
+        break;
+
+    case stfu::test_result::TIMEOUT:
+        out << "\aTIMEOUT";
+        break;
+
+    case stfu::test_result::SLOW:
+        out << "\aSLOW";
+        break;
+
+    case stfu::test_result::OUT_OF_RESOURCES:
+        out << "\aOUT_OF_RESOURCES";
+        break;
+    }
+
+    if (!d.message.empty()) {
+        out << " (" << d.message << ")";
+    }
+
+    return out;
+}
+
+//
+// Pretty-print the resources used by a test, using the names of the rusage
+// fields.
+//
+
+STFU_INLINE std::ostream&
+operator<<(std::ostream& out, const stfu::resource_usage& u)
+{
+    out << "utime " << u.user.count() << "s"
+        << ", stime " << u.system.count() << "s"
+        << ", maxrss " << u.max_rss << "KiB"
+        << ", minflt " << u.minor_faults
+        << ", majflt " << u.major_faults
+        << ", nvcsw " << u.voluntary_switches
+        << ", nivcsw " << u.involuntary_switches;
+
+    return out;
+}
+
+//
+// Pretty-print the heap allocations made by a test.
+//
+
+STFU_INLINE std::ostream&
+operator<<(std::ostream& out, const stfu::allocation_counts& a)
+{
+    out << "allocs " << a.allocations
+        << ", frees " << a.deallocations
+        << ", bytes " << a.bytes;
+
+    return out;
+}
+
+//
+// Pretty-print the performance counters of a test, leaving out those which
+// weren't counted.
+//
+
+STFU_INLINE std::ostream&
+operator<<(std::ostream& out, const stfu::perf_counters& c)
+{
+    const char* sep = "";
+
+    auto field = [&](const char* name, long long value) {
+        if (0 <= value) {
+            out << sep << name << " " << value;
+            sep = ", ";
+        }
+    };
+
+    field("cycles", c.cycles);
+    field("instructions", c.instructions);
+    if (0 < c.cycles && 0 <= c.instructions) {
+        out << sep << "ipc " << static_cast<double>(c.instructions) / c.cycles;
+    }
+    field("cache-refs", c.cache_references);
+    field("cache-misses", c.cache_misses);
+    field("branch-misses", c.branch_misses);
+    if (0 <= c.task_clock) {
+        out << sep << "task-clock " << c.task_clock / 1e9 << "s";
+        sep = ", ";
+    }
+
+    if ('\0' == *sep) {
+        out << "no counters";
+    }
+
+    return out;
+}
+
+//
+// test class implementation
+//
+
+STFU_INLINE
+stfu::test::test(const char* n, test_routine f, const char* d) noexcept:
+    fn{std::move(f)}, name{n}, description{d}
+{
+}
+
+STFU_INLINE
+stfu::test::execution::execution(execution&& x) noexcept:
+    pid{x.pid}, filedes{x.filedes[read_end], x.filedes[write_end]},
+    relay{x.relay}, cgroup{std::move(x.cgroup)}
+{
+    x.pid = -1;
+    x.filedes[read_end] = x.filedes[write_end] = -1;
+    x.relay = -1;
+}
+
+STFU_INLINE stfu::test::execution&
+stfu::test::execution::operator=(execution&& x) noexcept
+{
+    if (this != &x) {
+        for (int i: { filedes[read_end], filedes[write_end], relay }) {
+            if (-1 != i) {
+                ::close(i);
+            }
+        }
+
+        pid = x.pid;
+        filedes[read_end] = x.filedes[read_end];
+        filedes[write_end] = x.filedes[write_end];
+        relay = x.relay;
+        cgroup = std::move(x.cgroup);
+        x.pid = -1;
+        x.filedes[read_end] = x.filedes[write_end] = -1;
+        x.relay = -1;
+    }
+
+    return *this;
+}
+
+STFU_INLINE
+stfu::test::execution::~execution()
+{
+    for (int i: { filedes[read_end], filedes[write_end], relay }) {
+        if (-1 != i) {
+            ::close(i);
+        }
+    }
+}
+
+STFU_INLINE const std::string&
+stfu::test::get_name() const noexcept
+{
+    return name;
+}
+
+STFU_INLINE const std::string&
+stfu::test::get_description() const noexcept
+{
+    return description;
+}
+
+STFU_INLINE bool
+stfu::test::is_enabled() const noexcept
+{
+    return enabled;
+}
+
+STFU_INLINE stfu::test::seconds
+stfu::test::get_timeout() const noexcept
+{
+    return timeout;
+}
+
+STFU_INLINE stfu::execution_mode
+stfu::test::get_mode() const noexcept
+{
+    return mode;
+}
+
+STFU_INLINE stfu::test::seconds
+stfu::test::get_budget() const noexcept
+{
+    return budget;
+}
+
+STFU_INLINE const stfu::placement&
+stfu::test::get_placement() const noexcept
+{
+    return place;
+}
+
+STFU_INLINE const stfu::resource_limits&
+stfu::test::get_limits() const noexcept
+{
+    return limits;
+}
+
+STFU_INLINE stfu::test&
+stfu::test::set_enable(bool b) noexcept
+{
+    enabled = b;
+    return *this;
+}
+
+//
+// Limit the wall-clock time the test may run; zero means no limit. When set,
+// this takes precedence over the timeout of any group the test runs in.
+//
+STFU_INLINE stfu::test&
+stfu::test::set_timeout(seconds t) noexcept
+{
+    timeout = t;
+    return *this;
+}
+
+//
+// Choose how the test routine is executed. IN_PROCESS skips the cost of
+// forking a child, at the expense of isolation: a crash takes down the whole
+// program, side effects persist, and timeouts can't be enforced.
+//
+STFU_INLINE stfu::test&
+stfu::test::set_mode(execution_mode m) noexcept
+{
+    mode = m;
+    return *this;
+}
+
+//
+// Limit the time the test body may take, when run in a group; a test which
+// passes but takes longer is reported as SLOW. Zero means no limit. When
+// set, this takes precedence over the budget of the group.
+//
+STFU_INLINE stfu::test&
+stfu::test::set_budget(seconds t) noexcept
+{
+    budget = t;
+    return *this;
+}
+
+//
+// Choose where the test's child process runs, and how it's scheduled, when
+// forked by a group. Whatever is set takes precedence over the placement of
+// the group. Tests run in process (or batched) stay where they are.
+//
+STFU_INLINE stfu::test&
+stfu::test::set_placement(const placement& p)
+{
+    place = p;
+    return *this;
+}
+
+//
+// Limit the resources the test's child process may use, when forked by a
+// group. A test which exceeds its CPU time, or its memory (or address space,
+// as its allocations fail), is reported as OUT_OF_RESOURCES. Each limit set
+// takes precedence over that of the group.
+//
+STFU_INLINE stfu::test&
+stfu::test::set_limits(const resource_limits& l) noexcept
+{
+    limits = l;
+    return *this;
+}
+
+//
+// The mode in which the test runs, given that of the group it's run in.
+//
+STFU_INLINE stfu::execution_mode
+stfu::test::mode_in(execution_mode group_mode) const noexcept
+{
+    if (execution_mode::DEFAULT != mode) {
+        return mode;
+    }
+
+    if (execution_mode::DEFAULT != group_mode) {
+        return group_mode;
+    }
+
+    return execution_mode::FORKED;
+}
+
+STFU_INLINE void
+stfu::test::execution::close_handle(pipe_end e) noexcept
+{
+    ::close(filedes[e]);
+    filedes[e] = -1;
+}
+
+//
+// Run the test routine, interpreting its pass/fail protocol into the result
+// and timing it. Records it makes along the way go to the current sink.
+//
+STFU_INLINE void
+stfu::test::execute(test_result_data& r, const run_settings& settings) const
+{
+    using namespace std::chrono;
+
+    // Returning without an explicit result is a FAIL.
+    r.result = stfu::test_result::FAIL;
+
+    stfu_private::perf_events events{settings.counters};
+    const auto before = stfu_private::allocations_now();
+    const auto t1 = steady_clock::now();
+
+    events.start();
+
+    try {
+        fn();
+    } catch (const stfu_private::pass&) {
+        r.result = stfu::test_result::PASS;
+    } catch (const stfu_private::fail& e) {
+        r.message = e.get_message();
+    } catch (const std::bad_alloc& e) {
+        r.result = stfu::test_result::OUT_OF_RESOURCES;
+        r.message.append("out of memory: ").append(e.what());
+    } catch (const std::exception& e) {
+        r.result = stfu::test_result::CRASH;
+        r.message.append("uncaught exception: ").append(e.what());
+    } catch (...) {
+        r.result = stfu::test_result::CRASH;
+        r.message = "uncaught exception";
+    }
+
+    events.stop(r.counters);
+    r.phases.body = duration_cast<seconds>(steady_clock::now() - t1);
+    r.allocations = stfu_private::allocations_since(
+            before, stfu_private::allocations_now());
+}
+
+//
+// Run the test routine directly, as would a child process.
+//
+STFU_INLINE stfu::test_result_data
+stfu::test::run_in_process(const run_settings& settings) const
+{
+    using namespace std::chrono;
+
+    stfu::test_result_data r;
+
+    const auto before = stfu_private::usage_self();
+    auto t1 = steady_clock::now();
+
+    {
+        stfu_private::redirect to{r};
+        execute(r, settings);
+    }
+
+    auto t2 = steady_clock::now();
+
+    r.runtime = duration_cast<duration<double>>(t2 - t1);
+    r.usage = stfu_private::usage_since(before, stfu_private::usage_self());
+
+    return r;
+}
+
+//
+// Fork a child process to run the test routine, which streams its records
+// back over a pipe, concluding with its result. The child's standard output
+// and error are redirected to the given descriptor, if any. Returns the
+// child's pid (as recorded in the execution), or -1 if it couldn't start.
+//
+STFU_INLINE pid_t
+stfu::test::spawn(execution& x, seconds& forking, int output,
+                  const run_settings& settings) const
+{
+    using namespace std::chrono;
+
+    if (0 != ::pipe(x.filedes)) {
+        x.filedes[read_end] = x.filedes[write_end] = -1;
+        return x.pid = -1;
+    }
+
+    // The child mustn't inherit (and so repeat) buffered output.
+    stfu_private::flush_stdio();
+
+    const auto t1 = steady_clock::now();
+
+    // A plain function can be run by a child of the zygote, if there is one,
+    // unless it needs the group's arenas or its fixtures' effects, which the
+    // zygote lacks. The zygote relays the child's exit over a pipe of its own.
+    auto& zygote = stfu_private::zygote::instance();
+    auto* const routine = fn.target<void (*)()>();
+    pid_t pid = -1;
+    int relay[2];
+
+    if (nullptr != routine && !settings.fork_here && zygote.available() &&
+        0 == ::pipe(relay)) {
+        pid = zygote.spawn(*routine, settings, x.filedes[write_end],
+                           relay[1], output);
+        ::close(relay[1]);
+        if (-1 == pid) {
+            ::close(relay[0]);
+        } else {
+            x.relay = relay[0];
+        }
+    }
+
+    if (-1 == pid) {
+        pid = ::fork();
+    }
+
+    switch (pid) {
+    // Error case
+    case -1:
+        x.close_handle(read_end);
+        x.close_handle(write_end);
+        break;
+
+    // Child
+    case 0:
+        x.close_handle(read_end);
+        run_child(x.filedes[write_end], output, settings);
+
+    // Parent
+    default:
+        forking = duration_cast<seconds>(steady_clock::now() - t1);
+        x.close_handle(write_end);
+        if (!settings.cgroup.empty()) {
+            x.cgroup = stfu_private::cgroup_of(settings.cgroup, pid);
+        }
+    }
+
+    return x.pid = pid;
+}
+
+//
+// Body of a child process running the test routine: place and limit it,
+// redirect its output (if given), then run the routine and stream its
+// records back, concluding with its result.
+//
+STFU_INLINE void
+stfu::test::run_child(int channel, int output,
+                      const run_settings& settings) const
+{
+    if (-1 != output) {
+        ::dup2(output, STDOUT_FILENO);
+        ::dup2(output, STDERR_FILENO);
+        ::close(output);
+    }
+
+    auto notes = stfu_private::place(settings.place);
+    const auto limited = stfu_private::limit(settings.limits,
+                                             settings.cgroup);
+    notes.insert(notes.end(), limited.begin(), limited.end());
+    test_result_data r;
+    stfu_private::redirect to{channel};
+
+    for (const auto &n: notes) {
+        stfu::note(n);
+    }
+
+    execute(r, settings);
+
+    stfu_private::send_result(channel, r);
+    ::close(channel);
+    ::exit(0);
+}
+
+//
+// Compute the deadline for a test started now, given the timeout of the
+// group it's run in (if any).
+//
+STFU_INLINE stfu::test::deadline
+stfu::test::deadline_for(seconds group_timeout) const noexcept
+{
+    using namespace std::chrono;
+
+    const seconds t = (timeout > seconds::zero()) ? timeout : group_timeout;
+
+    if (t <= seconds::zero()) {
+        return deadline::max();
+    }
+
+    return steady_clock::now() + duration_cast<steady_clock::duration>(t);
+}
+
+//
+// Wait for a child started by spawn() to terminate and collect its result,
+// along with any records it sent which have yet to be received. A child
+// still running at the deadline is killed, and the test reported as having
+// timed out.
+//
+STFU_INLINE stfu::test_result_data
+stfu::test::reap(execution& x, deadline limit,
+                 stfu_private::receiver& rx) const noexcept
+{
+    using namespace std::chrono;
+
+    int stat_loc;
+    bool killed;
+    rusage ru;
+
+    // A child which sent a malformed result is killed at once.
+    const auto t1 = steady_clock::now();
+    const pid_t pid = x.pid;
+    const auto until = rx.corrupted() ? deadline::min() : limit;
+    pid_t rc = (-1 == x.relay) ?
+            stfu_private::wait(pid, stat_loc, until, killed, &ru) :
+            stfu_private::wait_relayed(x.relay, pid, stat_loc, until, killed,
+                                       &ru);
+
+    rx.drain(x.filedes[read_end]);
+    x.close_handle(read_end);
+    x.pid = -1;
+    if (-1 != x.relay) {
+        ::close(x.relay);
+        x.relay = -1;
+    }
+
+    const bool oom = !x.cgroup.empty() &&
+                     stfu_private::release_cgroup(x.cgroup);
+    x.cgroup.clear();
+
+    stfu::test_result_data r = std::move(rx.data);
+    r.phases.reap = duration_cast<seconds>(steady_clock::now() - t1);
+
+    if (rc == pid) {
+        r.usage = stfu_private::usage_of(ru);
+    }
+
+    // A malformed result means the protocol broke down: a crash.
+    if (rx.corrupted()) {
+        r.result = stfu::test_result::CRASH;
+        r.message = "Malformed result record";
+        return r;
+    }
+
+    // Iff the child exited with 0 having sent its result, that stands.
+    if (rc == pid && !killed && WIFEXITED(stat_loc) &&
+        (0 == WEXITSTATUS(stat_loc))) {
+        if (!rx.concluded()) {
+            r.result = stfu::test_result::FAIL;
+            r.message = "Test system failure";
+        }
+        return r;
+    }
+
+    // Test ran; default result is FAIL.
+    r.result = stfu::test_result::FAIL;
+    r.message.clear();
+
+    // Unable to reap the child.
+    if (rc != pid) {
+        return r;
+    }
+
+    if (killed) {
+        r.result = stfu::test_result::TIMEOUT;
+    }
+
+    // The kernel kills whatever exceeds the memory of its cgroup.
+    else if (oom) {
+        r.result = stfu::test_result::OUT_OF_RESOURCES;
+        r.message = "out of memory: exceeded cgroup memory limit";
+    }
+
+    // Any other signal-termination condition is considered a CRASH, unless
+    // it's that of a resource limit.
+    else {
+        stfu_private::describe_signal(stat_loc, r);
+    }
+
+    return r;
+}
+
+STFU_INLINE stfu::test_result_data
+stfu::test::operator()() const
+{
+    using namespace std::chrono;
+
+    stfu::test_result_data r;
+
+    if (!enabled) {
+        r.result = stfu::test_result::SKIPPED;
+        return r;
+    }
+
+    if (execution_mode::IN_PROCESS == mode_in(execution_mode::DEFAULT)) {
+        return run_in_process(run_settings{});
+    }
+
+    auto t1 = steady_clock::now();
+    const deadline limit = deadline_for(seconds::zero());
+    stfu_private::receiver rx;
+    seconds forking{0};
+    execution x;
+
+    if (-1 != spawn(x, forking, -1, run_settings{})) {
+        // Collect records until the child closes its end of the pipe (or
+        // the deadline passes), then reap it.
+        pollfd fd{x.filedes[read_end], POLLIN, 0};
+
+        for (;;) {
+            int rc = ::poll(&fd, 1, stfu_private::poll_timeout(limit));
+
+            if (rc < 0 && EINTR == errno) {
+                continue;
+            }
+
+            if (rc < 1 || !rx.receive(fd.fd)) {
+                break;
+            }
+        }
+
+        r = reap(x, limit, rx);
+        r.phases.fork = forking;
+    }
+
+    auto t2 = steady_clock::now();
+
+    r.runtime = duration_cast<duration<double>>(t2 - t1);
+
+    return r;
+}
+
+//
+// benchmark implementation
+//
+
+STFU_INLINE
+stfu::benchmark::benchmark(const char* n, test_routine f, const char* d):
+    test{n, nullptr, d}, body{std::move(f)}
+{
+    rebind();
+}
+
+STFU_INLINE stfu::benchmark&
+stfu::benchmark::set_warmup(std::size_t n)
+{
+    warmup = n;
+    rebind();
+    return *this;
+}
+
+STFU_INLINE stfu::benchmark&
+stfu::benchmark::set_iterations(std::size_t n)
+{
+    iterations = n;
+    rebind();
+    return *this;
+}
+
+STFU_INLINE stfu::benchmark&
+stfu::benchmark::set_time_budget(seconds t)
+{
+    budget = t;
+    rebind();
+    return *this;
+}
+
+//
+// Make the test routine measure the body with the current settings. The
+// routine captures them by value, so that it's unaffected by a benchmark
+// being added to a group as a plain test.
+//
+STFU_INLINE void
+stfu::benchmark::rebind()
+{
+    const test_routine b = body;
+    const std::size_t w = warmup;
+    const std::size_t n = iterations;
+    const seconds t = budget;
+
+    fn = [b, w, n, t]{
+        measure(b, w, n, t);
+        STFU_PASS();
+    };
+}
+
+STFU_INLINE void
+stfu::benchmark::measure(const test_routine& body, std::size_t warmup,
+                         std::size_t iterations, seconds budget)
+{
+    using namespace std::chrono;
+
+    auto time = [&body](std::size_t n) {
+        const auto t1 = steady_clock::now();
+        for (std::size_t i = 0; i < n; ++i) {
+            body();
+        }
+        const auto t2 = steady_clock::now();
+        return duration_cast<duration<double, std::nano>>(t2 - t1).count();
+    };
+
+    time(warmup);
+
+    // Batch iterations, so that each sample takes long enough to dwarf the
+    // cost of reading the clock. Calibration runs count as warmup.
+    std::size_t batch = 1;
+    while ((0 == iterations || batch < iterations) &&
+           batch < (std::size_t{1} << 30) && time(batch) < 10000.0) {
+        batch *= 2;
+    }
+    if (0 != iterations) {
+        batch = std::min(batch, iterations);
+    }
+
+    const auto end = steady_clock::now() +
+                     duration_cast<steady_clock::duration>(budget);
+    std::vector<double> samples;        // ns per iteration
+    std::size_t done = 0;
+    double total = 0;
+
+    while ((0 != iterations) ? (done < iterations) :
+           (0 == done || steady_clock::now() < end)) {
+        const std::size_t k = (0 != iterations) ?
+                std::min(batch, iterations - done) : batch;
+        const double ns = time(k);
+
+        samples.push_back(ns / k);
+        done += k;
+        total += ns;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    const std::size_t size = samples.size();
+    const double mean = total / done;
+    const double median = (size % 2) ? samples[size / 2] :
+            (samples[size / 2 - 1] + samples[size / 2]) / 2;
+    const std::size_t p99 = static_cast<std::size_t>(
+            std::ceil(0.99 * size)) - 1;
+
+    double variance = 0;
+    for (const auto ns: samples) {
+        variance += (ns - mean) * (ns - mean);
+    }
+    variance /= (size > 1) ? (size - 1) : 1;
+
+    stfu::metric("iterations", done);
+    stfu::metric("ns/op", mean);
+    stfu::metric("ns/op min", samples.front());
+    stfu::metric("ns/op median", median);
+    stfu::metric("ns/op p99", samples[p99]);
+    stfu::metric("ns/op stddev", std::sqrt(variance));
+}
+
+//
+// stress implementation
+//
+
+STFU_INLINE
+stfu::stress::stress(const char* n, stress_routine f, const char* d):
+    test{n, nullptr, d}, body{std::move(f)}
+{
+    rebind();
+}
+
+STFU_INLINE stfu::stress&
+stfu::stress::set_threads(std::size_t n)
+{
+    threads = n;
+    rebind();
+    return *this;
+}
+
+STFU_INLINE stfu::stress&
+stfu::stress::set_iterations(std::size_t n)
+{
+    iterations = n;
+    rebind();
+    return *this;
+}
+
+STFU_INLINE stfu::stress&
+stfu::stress::set_time_budget(seconds t)
+{
+    budget = t;
+    rebind();
+    return *this;
+}
+
+//
+// As for benchmarks, the test routine captures the settings by value.
+//
+STFU_INLINE void
+stfu::stress::rebind()
+{
+    const stress_routine b = body;
+    const std::size_t k = threads;
+    const std::size_t n = iterations;
+    const seconds t = budget;
+
+    fn = [b, k, n, t]{
+        run(b, k, n, t);
+        STFU_PASS();
+    };
+}
+
+STFU_INLINE void
+stfu::stress::run(const stress_routine& body, std::size_t threads,
+                  std::size_t iterations, seconds budget)
+{
+    using namespace std::chrono;
+
+    if (0 == threads) {
+        const long n = ::sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (n > 0) ? static_cast<std::size_t>(n) : 1;
+    }
+
+    std::atomic<std::size_t> ready{0};
+    std::atomic<bool> stop{false};
+    std::exception_ptr failure;
+    std::atomic_flag failed = ATOMIC_FLAG_INIT;
+    std::vector<std::size_t> done(threads, 0);
+    std::vector<double> elapsed(threads, 0);
+    std::vector<std::thread> pool;
+
+    auto thread = [&](std::size_t i) {
+        // Spin at the barrier, so that the threads start as one.
+        ++ready;
+        while (ready.load() < threads) {
+            std::this_thread::yield();
+        }
+
+        const auto t1 = steady_clock::now();
+        const auto end = t1 + duration_cast<steady_clock::duration>(budget);
+        std::size_t n = 0;
+
+        try {
+            while (!stop.load(std::memory_order_relaxed) &&
+                   ((0 != iterations) ? (n < iterations) :
+                    (0 != (n % 64) || steady_clock::now() < end))) {
+                try {
+                    body(i);
+                } catch (const stfu_private::pass&) {
+                    // A passing iteration; carry on.
+                }
+                ++n;
+            }
+        } catch (...) {
+            // Only the first failure is kept; it stops the others.
+            if (!failed.test_and_set()) {
+                failure = std::current_exception();
+            }
+            stop = true;
+        }
+
+        done[i] = n;
+        elapsed[i] = duration_cast<duration<double>>(
+                steady_clock::now() - t1).count();
+    };
+
+    try {
+        for (std::size_t i = 0; i < threads; ++i) {
+            pool.emplace_back(thread, i);
+        }
+    } catch (...) {
+        // Release (and stop) the threads that did start, then give up.
+        stop = true;
+        ready += threads - pool.size();
+        for (auto &t: pool) {
+            t.join();
+        }
+        throw;
+    }
+
+    for (auto &t: pool) {
+        t.join();
+    }
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+
+    double total = 0;
+    std::size_t count = 0;
+
+    for (std::size_t i = 0; i < threads; ++i) {
+        const double rate = (elapsed[i] > 0) ? done[i] / elapsed[i] : 0;
+        stfu::metric("ops/s thread " + std::to_string(i), rate);
+        total += rate;
+        count += done[i];
+    }
+
+    stfu::metric("threads", threads);
+    stfu::metric("iterations", count);
+    stfu::metric("ops/s", total);
+}
+
+STFU_INLINE void
+stfu::clobber() noexcept
+{
+#if defined(__GNUC__)
+    asm volatile("" : : : "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+//
+// arena implementation
+//
+
+STFU_INLINE
+stfu::arena::arena(const char* n, std::size_t size, setup_routine f) noexcept:
+    name{n}, length{size}, setup{std::move(f)}
+{
+}
+
+STFU_INLINE
+stfu::arena::~arena()
+{
+    unmap();
+}
+
+//
+// Size of the writable section, in bytes; none by default.
+//
+STFU_INLINE stfu::arena&
+stfu::arena::set_shared_size(std::size_t size) noexcept
+{
+    shared_length = size;
+    return *this;
+}
+
+//
+// Map the arena on huge pages, if the system has any to spare; else on
+// normal pages, advising the kernel to use transparent huge pages.
+//
+STFU_INLINE stfu::arena&
+stfu::arena::set_huge_pages(bool enable) noexcept
+{
+    huge_pages = enable;
+    return *this;
+}
+
+//
+// Back the read-only section with the given file (created, or truncated to
+// size, as needed) rather than anonymous memory.
+//
+STFU_INLINE stfu::arena&
+stfu::arena::set_file(const std::string& path)
+{
+    file = path;
+    return *this;
+}
+
+STFU_INLINE const std::string&
+stfu::arena::get_name() const noexcept
+{
+    return name;
+}
+
+//
+// The read-only section; null until the arena is mapped.
+//
+STFU_INLINE const void*
+stfu::arena::data() const noexcept
+{
+    return region;
+}
+
+STFU_INLINE std::size_t
+stfu::arena::size() const noexcept
+{
+    return length;
+}
+
+//
+// The writable section; null until the arena is mapped (or if it has none).
+//
+STFU_INLINE void*
+stfu::arena::shared() const noexcept
+{
+    return section;
+}
+
+STFU_INLINE std::size_t
+stfu::arena::shared_size() const noexcept
+{
+    return shared_length;
+}
+
+//
+// Map the arena and set it up, unless already done, then protect the
+// read-only section; the children forked afterwards inherit the mappings.
+// Returns false if the arena couldn't be mapped or set up.
+//
+STFU_INLINE bool
+stfu::arena::map()
+{
+    if (nullptr != region) {
+        return true;
+    }
+
+    const std::size_t page = ::sysconf(_SC_PAGESIZE);
+    const std::size_t huge_page = std::size_t{2} << 20;
+
+    auto round = [](std::size_t n, std::size_t unit) {
+        return std::max((n + unit - 1) / unit, std::size_t{1}) * unit;
+    };
+
+    auto anonymous = [&](std::size_t n, std::size_t& mapped) -> void* {
+        void* p = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+        if (huge_pages) {
+            mapped = round(n, huge_page);
+            p = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+#endif
+
+        if (MAP_FAILED == p) {
+            mapped = round(n, page);
+            p = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+            if (MAP_FAILED != p && huge_pages) {
+                ::madvise(p, mapped, MADV_HUGEPAGE);
+            }
+#endif
+        }
+
+        return (MAP_FAILED == p) ? nullptr : p;
+    };
+
+    if (file.empty()) {
+        region = anonymous(length, region_size);
+    } else {
+        const int fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                              0600);
+
+        if (-1 != fd && 0 == ::ftruncate(fd, length)) {
+            region_size = round(length, page);
+            void* p = ::mmap(nullptr, region_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd, 0);
+            region = (MAP_FAILED == p) ? nullptr : p;
+        }
+
+        if (-1 != fd) {
+            ::close(fd);
+        }
+    }
+
+    if (nullptr == region ||
+        (0 != shared_length &&
+         nullptr == (section = anonymous(shared_length, section_size)))) {
+        unmap();
+        return false;
+    }
+
+    try {
+        if (setup) {
+            setup(region, length);
+        }
+    } catch (...) {
+        unmap();
+        return false;
+    }
+
+    if (0 != ::mprotect(region, region_size, PROT_READ)) {
+        unmap();
+        return false;
+    }
+
+    return true;
+}
+
+STFU_INLINE void
+stfu::arena::unmap() noexcept
+{
+    if (nullptr != region) {
+        ::munmap(region, region_size);
+        region = nullptr;
+    }
+
+    if (nullptr != section) {
+        ::munmap(section, section_size);
+        section = nullptr;
+    }
+}
+
+//
+// test_group implementation
+//
+
+STFU_INLINE
+stfu::test_group::test_group(const char* n, const char* d):
+    name{n}, description{d}
+{
+}
+
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_verbose(bool b) noexcept
+{
+    verbose = b;
+    return *this;
+}
+
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_jobs(std::size_t n) noexcept
+{
+    jobs = n;
+    return *this;
+}
+
+//
+// Limit the wall-clock time of each test in the group which doesn't set its
+// own timeout; zero means no limit.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_timeout(test::seconds t) noexcept
+{
+    timeout = t;
+    return *this;
+}
+
+STFU_INLINE stfu::test::seconds
+stfu::test_group::get_timeout() const noexcept
+{
+    return timeout;
+}
+
+//
+// Choose how the group's tests are executed, for those which don't choose
+// for themselves.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_mode(execution_mode m) noexcept
+{
+    mode = m;
+    return *this;
+}
+
+STFU_INLINE stfu::execution_mode
+stfu::test_group::get_mode() const noexcept
+{
+    return mode;
+}
+
+//
+// Capture each test's standard output and error, instead of letting it
+// interleave with the results. Captured output is shown for tests which
+// don't pass, or for all tests when verbose.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_capture(bool b) noexcept
+{
+    capture = b;
+    return *this;
+}
+
+//
+// Report the resources used by each test (CPU time, peak RSS, page faults
+// and context switches) in its result line.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_usage(bool b) noexcept
+{
+    usage = b;
+    return *this;
+}
+
+//
+// Report the time taken by each phase of running a test (forking, the test
+// body itself, reaping, and per-test fixtures) along with its result.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_phases(bool b) noexcept
+{
+    phases = b;
+    return *this;
+}
+
+//
+// Count hardware performance events (cycles, instructions, cache references
+// and misses, branch misses) and task-clock time of each test's body, and
+// report them. Counters which aren't available are left out.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_counters(bool enable) noexcept
+{
+    counters = enable;
+    return *this;
+}
+
+//
+// Choose where the children forked to run the group's tests run, and how
+// they're scheduled, for those which don't set a placement of their own.
+// Batched workers are placed likewise; tests run in process aren't.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_placement(const placement& p)
+{
+    place = p;
+    return *this;
+}
+
+//
+// Spread the children running the group's tests across CPUs, round-robin:
+// those of the group's placement, or else all those the program may run
+// on. Each child is pinned to a CPU none of the others running is on, if
+// there is one. Tests with CPUs of their own are left to them.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_spread(bool enable) noexcept
+{
+    spread = enable;
+    return *this;
+}
+
+//
+// Limit the resources of the children forked to run the group's tests, for
+// those which don't set limits of their own. Batched workers are limited
+// likewise, each as a whole; tests run in process aren't.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_limits(const resource_limits& l) noexcept
+{
+    limits = l;
+    return *this;
+}
+
+//
+// Run each forked child in a cgroup of its own, made under the given cgroup
+// (v2) directory, which must be delegated to the user running the tests.
+// Its memory limit is enforced there, and a child killed for exceeding it
+// is reported as OUT_OF_RESOURCES. An empty path (the default) uses none.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_cgroup(const std::string& path)
+{
+    cgroup = path;
+    return *this;
+}
+
+//
+// Limit the time the body of each test in the group may take, for those
+// which don't set a budget of their own; zero means no limit.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_budget(test::seconds t) noexcept
+{
+    budget = t;
+    return *this;
+}
+
+//
+// Compare the performance of passing tests against a baseline file (if it
+// exists), reporting those which have regressed as SLOW.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_baseline(const std::string& path)
+{
+    baseline = path;
+    return *this;
+}
+
+//
+// Once the group has run, record the performance of its passing tests in
+// the baseline file, for comparison by later runs.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_update_baseline(bool b) noexcept
+{
+    update_baseline = b;
+    return *this;
+}
+
+//
+// A test has regressed once its measure is more than this multiple of its
+// baseline.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_regression_ratio(double r) noexcept
+{
+    regression_ratio = r;
+    return *this;
+}
+
+//
+// Disregard any increase in the time of a test's body of no more than this,
+// however large relative to its baseline, since the times of short tests
+// are dominated by noise. Benchmarks are always held to the ratio alone.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_regression_slack(test::seconds t) noexcept
+{
+    regression_slack = t;
+    return *this;
+}
+
+//
+// Take the group's defaults from the environment, where set: its job count
+// (STFU_JOBS), timeout in seconds (STFU_TIMEOUT), baseline (STFU_BASELINE),
+// the shard of its tests to run (STFU_SHARD_INDEX of STFU_SHARD_COUNT,
+// weighted by STFU_SHARD_WEIGHTS), failure limit (STFU_MAX_FAILURES) and
+// cache (STFU_CACHE). Only top-level groups should, as run_main's do, not
+// those a test builds to run.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::apply_environment()
+{
+    unsigned long count;
+    double secs;
+
+    if (stfu_private::getenv("STFU_JOBS", count)) {
+        jobs = count;
+    }
+
+    if (stfu_private::getenv("STFU_TIMEOUT", secs)) {
+        timeout = test::seconds{secs};
+    }
+
+    if (const char* path = std::getenv("STFU_BASELINE")) {
+        baseline = path;
+    }
+
+    if (stfu_private::getenv("STFU_SHARD_COUNT", count)) {
+        shard_count = std::max(count, 1ul);
+    }
+
+    if (stfu_private::getenv("STFU_SHARD_INDEX", count)) {
+        shard_index = count;
+    }
+
+    if (const char* path = std::getenv("STFU_SHARD_WEIGHTS")) {
+        shard_weights = path;
+    }
+
+    if (stfu_private::getenv("STFU_MAX_FAILURES", count)) {
+        max_failures = count;
+    }
+
+    if (const char* path = std::getenv("STFU_CACHE")) {
+        cache = path;
+    }
+
+    return *this;
+}
+
+//
+// Run only a slice of the group's tests: the given one (counting from 0) of
+// so many shards. By default, tests are assigned to shards by a stable hash
+// of their names, so every machine agrees on the split.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_shard(std::size_t index, std::size_t count) noexcept
+{
+    shard_index = index;
+    shard_count = std::max(count, std::size_t{1});
+    return *this;
+}
+
+//
+// Stop the group once so many tests have failed (crashed, timed out or run
+// slow), killing any still running; 0 runs every test regardless. The tests
+// abandoned or never started are counted as not run.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_fail_fast(std::size_t failures) noexcept
+{
+    max_failures = failures;
+    return *this;
+}
+
+//
+// Balance shards by the tests' runtimes in a previous run's JSON report,
+// instead of by hash. Tests missing from the report are assumed to take the
+// average time.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_shard_weights(const std::string& path)
+{
+    shard_weights = path;
+    return *this;
+}
+
+//
+// Keep the last result and runtime of each test in the given file, from
+// which later runs may take the order and choice of tests to run.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_cache(const std::string& path)
+{
+    cache = path;
+    return *this;
+}
+
+//
+// Run (and report) the tests which failed last time, per the cache, first.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_failed_first(bool enable) noexcept
+{
+    failed_first = enable;
+    return *this;
+}
+
+//
+// Don't rerun tests which passed last time, per the cache, in the same
+// build; after a rebuild, every test runs.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_only_failed(bool enable) noexcept
+{
+    only_failed = enable;
+    return *this;
+}
+
+//
+// Start tests in the given order. Starting the longest first keeps a slow
+// test from starting last and holding up a parallel run; results are still
+// reported in the order selected.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_schedule(schedule_policy p) noexcept
+{
+    policy = p;
+    return *this;
+}
+
+//
+// Retain at most this many bytes of each test's captured output; only the
+// last part of anything longer is shown.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_capture_limit(std::size_t n) noexcept
+{
+    capture_limit = n;
+    return *this;
+}
+
+//
+// Capture each test's output to a file of its own in the given directory,
+// which the test writes to directly. This avoids passing large logs through
+// the runner at all; only the last part is read back for display.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::set_capture_dir(const std::string& dir)
+{
+    capture_dir = dir;
+    return *this;
+}
+
+//
+// Path of the file in which a test's output is captured: the group and test
+// names, with anything unsuitable for a filename replaced.
+//
+STFU_INLINE std::string
+stfu::test_group::capture_path(const test& t) const
+{
+    std::string file = name + "." + t.get_name() + ".log";
+
+    for (auto &c: file) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) &&
+            '.' != c && '-' != c) {
+            c = '_';
+        }
+    }
+
+    return capture_dir + "/" + file;
+}
+
+STFU_INLINE int
+stfu::test_group::open_capture(const test& t) const
+{
+    return ::open(capture_path(t).c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                  0644);
+}
+
+//
+// Run a test in-process with its output temporarily redirected, as when run
+// in a child.
+//
+STFU_INLINE stfu::test_result_data
+stfu::test_group::run_captured(const test& t) const
+{
+    stfu_private::ring tail{capture_limit};
+    test_result_data r;
+    int fd;
+
+    std::FILE* tmp = nullptr;
+
+    if (capture_dir.empty()) {
+        tmp = std::tmpfile();
+        fd = (nullptr != tmp) ? ::fileno(tmp) : -1;
+    } else {
+        fd = open_capture(t);
+    }
+
+    {
+        stfu_private::stdio_redirect to{fd};
+        r = t.run_in_process(settings_for(t));
+    }
+
+    if (capture_dir.empty()) {
+        stfu_private::read_tail(fd, tail);
+    }
+
+    if (nullptr != tmp) {
+        std::fclose(tmp);
+    } else if (-1 != fd) {
+        ::close(fd);
+    }
+
+    finish_capture(t, tail, r);
+
+    return r;
+}
+
+//
+// Move a test's captured output into its result.
+//
+STFU_INLINE void
+stfu::test_group::finish_capture(const test& t, stfu_private::ring& tail,
+                                 test_result_data& r) const
+{
+    if (!capture_dir.empty()) {
+        const int fd = ::open(capture_path(t).c_str(), O_RDONLY);
+        if (-1 != fd) {
+            stfu_private::read_tail(fd, tail);
+            ::close(fd);
+        }
+    }
+
+    r.output = tail.str();
+    r.output_size = tail.size();
+
+    if (!capture_dir.empty()) {
+        r.output_file = capture_path(t);
+    }
+}
+
+STFU_INLINE const std::string&
+stfu::test_group::get_name() const noexcept
+{
+    return name;
+}
+
+STFU_INLINE const std::string&
+stfu::test_group::get_description() const noexcept
+{
+    return description;
+}
+
+//
+// Number of tests the group runs: those in its shard.
+//
+STFU_INLINE std::size_t
+stfu::test_group::get_test_count() const noexcept
+{
+    if (shard_count <= 1) {
+        return tests.size();
+    }
+
+    try {
+        return shard().size();
+    } catch (...) {
+        return 0;
+    }
+}
+
+//
+// Number of tests which may run concurrently; a job count of 0 means one
+// per online CPU.
+//
+STFU_INLINE std::size_t
+stfu::test_group::get_jobs() const noexcept
+{
+    if (0 == jobs) {
+        long n = ::sysconf(_SC_NPROCESSORS_ONLN);
+        return (n > 0) ? static_cast<std::size_t>(n) : 1;
+    }
+
+    return jobs;
+}
+
+STFU_INLINE stfu::test_group&
+stfu::test_group::add_test(const stfu::test& test)
+{
+    tests.push_back(test);
+    return *this;
+}
+
+//
+// Share an arena with the group's tests, setting it up (if not already) as
+// the group runs. The arena must outlive the group's runs.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::add_arena(arena& a)
+{
+    arenas.push_back(&a);
+    return *this;
+}
+
+//
+// Add a test without copying its routine (and whatever that captures).
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::add_test(stfu::test&& test)
+{
+    tests.push_back(std::move(test));
+    return *this;
+}
+
+//
+// Add generated tests, all run in the given mode if not the default; run
+// BATCHED, a few children run every case between them, each streaming back
+// per-case results.
+//
+STFU_INLINE stfu::test_group&
+stfu::test_group::add_tests(std::vector<test>&& cases, execution_mode m)
+{
+    tests.reserve(tests.size() + cases.size());
+
+    for (auto &t: cases) {
+        if (execution_mode::DEFAULT != m) {
+            t.set_mode(m);
+        }
+        tests.push_back(std::move(t));
+    }
+
+    cases.clear();
+    return *this;
+}
+
+STFU_INLINE stfu::test_group&
+stfu::test_group::add_before_all(const fixture& f)
+{
+    before_all.push_back(f);
+    return *this;
+}
+
+STFU_INLINE stfu::test_group&
+stfu::test_group::add_before_each(const fixture& f)
+{
+    before_each.push_back(f);
+    return *this;
+}
+
+STFU_INLINE stfu::test_group&
+stfu::test_group::add_after_all(const fixture& f)
+{
+    after_all.push_back(f);
+    return *this;
+}
+
+STFU_INLINE stfu::test_group&
+stfu::test_group::add_after_each(const fixture& f)
+{
+    after_each.push_back(f);
+    return *this;
+}
+
+STFU_INLINE void
+stfu::test_group::run_fixtures(const std::vector<fixture>& fixtures,
+                               const char* phase) const
+{
+    for (const auto &f: fixtures) {
+        if (!f()) {
+            throw stfu_private::fixture_exception(phase);
+        }
+    }
+}
+
+//
+// How the group runs the given test's routine.
+//
+STFU_INLINE stfu::test::run_settings
+stfu::test_group::settings_for(const test& t) const
+{
+    test::run_settings settings;
+    const auto &own = t.get_placement();
+
+    settings.counters = counters;
+    settings.place = place;
+    if (!own.cpus.empty()) {
+        settings.place.cpus = own.cpus;
+    }
+    if (0 != own.nice) {
+        settings.place.nice = own.nice;
+    }
+    if (0 != own.fifo_priority) {
+        settings.place.fifo_priority = own.fifo_priority;
+    }
+    if (0 <= own.numa_node) {
+        settings.place.numa_node = own.numa_node;
+    }
+
+    const auto &bounds = t.get_limits();
+
+    settings.limits = limits;
+    settings.cgroup = cgroup;
+    settings.fork_here = !arenas.empty() || !before_all.empty() ||
+                         !before_each.empty();
+    if (0 != bounds.address_space) {
+        settings.limits.address_space = bounds.address_space;
+    }
+    if (0 != bounds.memory) {
+        settings.limits.memory = bounds.memory;
+    }
+    if (0 != bounds.cpu_time.count()) {
+        settings.limits.cpu_time = bounds.cpu_time;
+    }
+    if (0 != bounds.open_files) {
+        settings.limits.open_files = bounds.open_files;
+    }
+
+    return settings;
+}
+
+//
+// The CPUs across which the group spreads its tests' children.
+//
+STFU_INLINE std::vector<int>
+stfu::test_group::spread_cpus() const
+{
+    return place.cpus.empty() ? stfu_private::allowed_cpus() : place.cpus;
+}
+
+//
+// Indices of the tests in the group's shard, in declaration order.
+//
+STFU_INLINE std::vector<std::size_t>
+stfu::test_group::shard() const
+{
+    std::vector<std::size_t> selected;
+
+    if (shard_count <= 1 || shard_weights.empty()) {
+        for (std::size_t i = 0; i < tests.size(); ++i) {
+            const auto h = stfu_private::stable_hash(tests[i].get_name());
+            if (shard_count <= 1 || shard_index == h % shard_count) {
+                selected.push_back(i);
+            }
+        }
+        return selected;
+    }
+
+    const auto runtimes = stfu_private::load_runtimes(shard_weights, name);
+    std::vector<double> weight(tests.size(), -1);
+    double total = 0;
+    std::size_t known = 0;
+
+    for (std::size_t i = 0; i < tests.size(); ++i) {
+        const auto r = runtimes.find(tests[i].get_name());
+        if (runtimes.end() != r) {
+            weight[i] = r->second;
+            total += r->second;
+            ++known;
+        }
+    }
+
+    for (auto &w: weight) {
+        if (w < 0) {
+            w = (0 != known) ? total / known : 1;
+        }
+    }
+
+    // Longest first, each to the least loaded shard (the first, on a tie).
+    std::vector<std::size_t> order(tests.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+            [&weight](std::size_t a, std::size_t b) {
+                return weight[a] > weight[b];
+            });
+
+    std::vector<double> load(shard_count, 0);
+
+    for (const auto i: order) {
+        const auto least = std::min_element(load.begin(), load.end());
+        *least += weight[i];
+        if (shard_index == static_cast<std::size_t>(least - load.begin())) {
+            selected.push_back(i);
+        }
+    }
+
+    std::sort(selected.begin(), selected.end());
+    return selected;
+}
+
+//
+// Indices of the tests to run, in order: those in the group's shard, less
+// any known to pass, and with earlier failures first, as configured.
+//
+STFU_INLINE std::vector<std::size_t>
+stfu::test_group::select(const stfu_private::history& h) const
+{
+    std::vector<std::size_t> selected = shard();
+
+    auto entry = [&](std::size_t i) -> const stfu_private::cached* {
+        const auto e = h.find(tests[i].get_name());
+        return (h.end() == e) ? nullptr : &e->second;
+    };
+
+    if (only_failed) {
+        selected.erase(std::remove_if(selected.begin(), selected.end(),
+                [&](std::size_t i) {
+                    const auto e = entry(i);
+                    return e && e->passed() &&
+                           stfu_private::binary_key() == e->key;
+                }), selected.end());
+    }
+
+    if (failed_first) {
+        std::stable_partition(selected.begin(), selected.end(),
+                [&](std::size_t i) {
+                    const auto e = entry(i);
+                    return e && e->failed();
+                });
+    }
+
+    return selected;
+}
+
+//
+// The order in which to start the selected tests. Longest first, tests
+// missing from the cache are assumed to take the average time; with no
+// history at all, the order is as selected. Earlier failures which are to
+// run first still do.
+//
+STFU_INLINE std::vector<std::size_t>
+stfu::test_group::schedule(const std::vector<std::size_t>& selected,
+                           const stfu_private::history& h) const
+{
+    std::vector<std::size_t> order = selected;
+
+    if (schedule_policy::LONGEST_FIRST != policy) {
+        return order;
+    }
+
+    std::vector<double> runtime(tests.size(), -1);
+    std::vector<bool> failed(tests.size(), false);
+    double total = 0;
+    std::size_t known = 0;
+
+    for (const auto i: selected) {
+        const auto e = h.find(tests[i].get_name());
+        if (h.end() != e) {
+            runtime[i] = e->second.runtime;
+            failed[i] = failed_first && e->second.failed();
+            total += runtime[i];
+            ++known;
+        }
+    }
+
+    if (0 == known) {
+        return order;
+    }
+
+    for (auto &r: runtime) {
+        if (r < 0) {
+            r = total / known;
+        }
+    }
+
+    std::stable_sort(order.begin(), order.end(),
+            [&](std::size_t a, std::size_t b) {
+                return (failed[a] != failed[b]) ? failed[a] :
+                                                  runtime[a] > runtime[b];
+            });
+
+    return order;
+}
+
+//
+// Hold a passing test to its budget, and to its baseline (if any).
+//
+STFU_INLINE void
+stfu::test_group::judge(const test& t, test_result_data& r,
+                        const stfu_private::baseline& base) const
+{
+    if (test_result::PASS != r.result) {
+        return;
+    }
+
+    const test::seconds limit = (t.budget > test::seconds::zero()) ?
+                                t.budget : budget;
+    std::ostringstream why;
+
+    if (limit > test::seconds::zero() && r.phases.body > limit) {
+        why << "took " << r.phases.body.count() << "s, over budget of "
+            << limit.count() << "s";
+    } else {
+        const auto b = base.find(t.get_name());
+        const auto m = stfu_private::measure_of(r);
+        const double slack = ("s" == m.unit) ? regression_slack.count() : 0;
+
+        if (base.end() != b && b->second.unit == m.unit &&
+            b->second.value > 0 &&
+            m.value > b->second.value * regression_ratio &&
+            m.value > b->second.value + slack) {
+            why << m.unit << " of " << m.value << " is "
+                << (m.value / b->second.value) << "x baseline of "
+                << b->second.value;
+        }
+    }
+
+    if (!why.str().empty()) {
+        r.result = test_result::SLOW;
+        r.message = why.str();
+    }
+}
+
+//
+// Hand a batched test to an idle worker, starting a new worker if there are
+// none. Returns the index of the worker, or npos if none could be started.
+//
+STFU_INLINE std::size_t
+stfu::test_group::dispatch(std::vector<worker>& workers, std::size_t i,
+                           test::seconds& forking) const
+{
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+
+    for (;;) {
+        std::size_t w;
+
+        for (w = 0; w < workers.size(); ++w) {
+            if (-1 != workers[w].pid && !workers[w].busy) {
+                break;
+            }
+        }
+
+        // No idle worker; start a new one, reusing a defunct slot if any.
+        if (workers.size() == w) {
+            for (w = 0; w < workers.size(); ++w) {
+                if (-1 == workers[w].pid) {
+                    break;
+                }
+            }
+
+            if (workers.size() == w) {
+                workers.push_back(worker{-1, -1, -1, false,
+                                         resource_usage{}});
+            }
+
+            if (!start_worker(workers, w, forking)) {
+                return std::string::npos;
+            }
+        }
+
+        // A worker which can't take the command has exited; replace it.
+        if (sizeof(i) != ::send(workers[w].channel, &i, sizeof(i), flags)) {
+            stop_worker(workers[w]);
+            continue;
+        }
+
+        workers[w].busy = true;
+        return w;
+    }
+}
+
+STFU_INLINE bool
+stfu::test_group::start_worker(std::vector<worker>& workers,
+                               std::size_t w, test::seconds& forking) const
+{
+    using namespace std::chrono;
+
+    int sv[2];
+    int output[2] = { -1, -1 };
+
+    if (0 != ::socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+        return false;
+    }
+
+    // Unless each test has a file of its own, the worker's output goes to
+    // a pipe, from which it's attributed to whichever test is running.
+    if (capture && capture_dir.empty() && 0 != ::pipe(output)) {
+        ::close(sv[0]);
+        ::close(sv[1]);
+        return false;
+    }
+
+    // The worker mustn't inherit (and so repeat) buffered output.
+    stfu_private::flush_stdio();
+
+    const auto t1 = steady_clock::now();
+
+    switch (pid_t pid = ::fork()) {
+    // Error case
+    case -1:
+        for (int fd: {sv[0], sv[1], output[0], output[1]}) {
+            if (-1 != fd) {
+                ::close(fd);
+            }
+        }
+        return false;
+
+    // Child
+    case 0:
+        ::close(sv[0]);
+
+        if (-1 != output[1]) {
+            ::close(output[0]);
+            ::dup2(output[1], STDOUT_FILENO);
+            ::dup2(output[1], STDERR_FILENO);
+            ::close(output[1]);
+        }
+
+        // Don't hold other workers' channels open.
+        for (const auto &o: workers) {
+            if (-1 != o.pid) {
+                ::close(o.channel);
+            }
+            if (-1 != o.output) {
+                ::close(o.output);
+            }
+        }
+
+        {
+            // Spread workers as tests would be.
+            auto p = place;
+            const auto cpus = spread ? spread_cpus() : std::vector<int>{};
+            if (!cpus.empty()) {
+                p.cpus.assign(1, cpus[w % cpus.size()]);
+            }
+            auto notes = stfu_private::place(p);
+            const auto limited = stfu_private::limit(limits, "");
+            notes.insert(notes.end(), limited.begin(), limited.end());
+            serve(sv[1], notes);
+        }
+
+    // Parent
+    default:
+        forking = duration_cast<test::seconds>(steady_clock::now() - t1);
+        ::close(sv[1]);
+        if (-1 != output[1]) {
+            ::close(output[1]);
+        }
+        workers[w] = worker{pid, sv[0], output[0], false, resource_usage{}};
+    }
+
+    return true;
+}
+
+//
+// Body of a worker process: run each test as commanded, streaming back its
+// records and then its result, noting with each whatever of the worker's
+// placement couldn't be applied. The worker exits once its channel is shut
+// down.
+//
+STFU_INLINE void
+stfu::test_group::serve(int channel,
+                        const std::vector<std::string>& notes) const
+{
+    stfu_private::redirect to{channel};
+    std::size_t i;
+
+    while (stfu_private::read_all(channel, &i, sizeof(i)) &&
+           i < tests.size()) {
+        test_result_data r;
+
+        for (const auto &n: notes) {
+            stfu::note(n);
+        }
+
+        if (capture && !capture_dir.empty()) {
+            const int fd = open_capture(tests[i]);
+            stfu_private::stdio_redirect to{fd};
+            if (-1 != fd) {
+                ::close(fd);
+            }
+            tests[i].execute(r, settings_for(tests[i]));
+        } else {
+            tests[i].execute(r, settings_for(tests[i]));
+            stfu_private::flush_stdio();
+        }
+
+        // The parent attributes the usage since the previous test to this.
+        const auto used = stfu_private::usage_self();
+        stfu_private::send(channel, stfu_private::record::USAGE,
+                std::string(reinterpret_cast<const char*>(&used),
+                            sizeof(used)));
+
+        if (!stfu_private::send_result(channel, r)) {
+            break;
+        }
+    }
+
+    ::exit(0);
+}
+
+STFU_INLINE void
+stfu::test_group::stop_worker(worker& w) const noexcept
+{
+    int stat_loc;
+    bool killed;
+
+    if (-1 == w.pid) {
+        return;
+    }
+
+    if (w.busy) {
+        ::kill(w.pid, SIGKILL);
+    }
+
+    ::shutdown(w.channel, SHUT_RDWR);
+    ::close(w.channel);
+    stfu_private::wait(w.pid, stat_loc,
+                       std::chrono::steady_clock::time_point::max(), killed);
+
+    if (-1 != w.output) {
+        ::close(w.output);
+    }
+
+    w = worker{-1, -1, -1, false, resource_usage{}};
+}
+
+//
+// Receive whatever a busy worker has sent, and determine whether the test
+// it's running has concluded. If the worker terminates (or is killed at the
+// deadline) the test it was running is held responsible, and the worker is
+// replaced upon the next dispatch; its output pipe is left for the caller to
+// drain and close.
+//
+STFU_INLINE bool
+stfu::test_group::collect(worker& w, bool readable, test::deadline limit,
+                          stfu_private::receiver& rx) const
+{
+    // Unless it's already on its way out, a worker is killed at once.
+    auto when = test::deadline::min();
+
+    if (readable) {
+        if (rx.receive(w.channel)) {
+            if (rx.concluded()) {
+                const auto used = rx.data.usage;
+                rx.data.usage = stfu_private::usage_since(w.used, used);
+                w.used = used;
+                w.busy = false;
+                return true;
+            }
+
+            if (std::chrono::steady_clock::now() < limit) {
+                return false;
+            }
+        } else if (!rx.corrupted()) {
+            when = limit;
+        }
+    }
+
+    // Test ran; default result is FAIL.
+    rx.data.result = test_result::FAIL;
+
+    int stat_loc;
+    bool killed;
+    rusage ru;
+
+    const auto t1 = std::chrono::steady_clock::now();
+
+    if (w.pid == stfu_private::wait(w.pid, stat_loc, when, killed, &ru)) {
+        rx.data.usage = stfu_private::usage_since(w.used,
+                                                  stfu_private::usage_of(ru));
+        if (killed) {
+            rx.data.result = test_result::TIMEOUT;
+        } else {
+            stfu_private::describe_signal(stat_loc, rx.data);
+        }
+    }
+
+    // A malformed result means the protocol broke down: a crash.
+    if (rx.corrupted()) {
+        rx.data.result = test_result::CRASH;
+        rx.data.message = "Malformed result record";
+    }
+
+    rx.data.phases.reap = std::chrono::duration_cast<test::seconds>(
+            std::chrono::steady_clock::now() - t1);
+
+    ::close(w.channel);
+    w = worker{-1, -1, w.output, false, resource_usage{}};
+
+    return true;
+}
+
+STFU_INLINE stfu::test_result_summary
+stfu::test_group::operator()() const
+{
+    return (*this)(std::cout);
+}
+
+STFU_INLINE stfu::test_result_summary
+stfu::test_group::operator()(std::ostream& out) const
+{
+    text_reporter report{out};
+    return (*this)(report);
+}
+
+STFU_INLINE stfu::test_result_summary
+stfu::test_group::operator()(reporter& events) const
+{
+    using namespace std::chrono;
+
+    //
+    // A test which has been started in a child process, but not yet reaped.
+    //
+    struct running_test {
+        std::size_t index;
+        test::execution child;  // The worker's pid, if batched
+        steady_clock::time_point start;
+        test::deadline limit;
+        std::size_t worker;     // npos unless batched
+        stfu_private::receiver rx;
+        int output;             // Captured output pipe, unless batched
+        stfu_private::ring tail;
+        test::seconds forking;
+        int cpu;                // Spread onto, if any
+    };
+
+    test_result_summary results;
+
+    // Results are collected as tests conclude (which, when running in
+    // parallel, may be out of order) and reported in the order selected:
+    // declaration order, unless running earlier failures first.
+    const auto last = cache.empty() ? stfu_private::history{} :
+                      stfu_private::load_history(cache, name);
+    const std::vector<std::size_t> selected = select(last);
+    const std::vector<std::size_t> order = schedule(selected, last);
+    std::vector<test_result_data> data(tests.size());
+    std::vector<bool> concluded(tests.size(), false);
+    std::vector<running_test> running;
+    std::vector<worker> workers;
+    std::size_t next_run = 0;
+    std::size_t next_report = 0;
+    const std::size_t max_jobs = get_jobs();
+
+    // CPUs to spread children across, and the next in turn.
+    const std::vector<int> cpus = spread ? spread_cpus() : std::vector<int>{};
+    std::size_t next_cpu = 0;
+
+    // The next CPU in turn which no running child is spread onto, if any;
+    // otherwise, the next in turn.
+    auto pick_cpu = [&]() {
+        for (std::size_t k = 0; k < cpus.size(); ++k) {
+            const int cpu = cpus[(next_cpu + k) % cpus.size()];
+            const bool busy = std::any_of(running.begin(), running.end(),
+                    [cpu](const running_test& rt) { return cpu == rt.cpu; });
+            if (!busy) {
+                next_cpu = (next_cpu + k + 1) % cpus.size();
+                return cpu;
+            }
+        }
+        const int cpu = cpus[next_cpu];
+        next_cpu = (next_cpu + 1) % cpus.size();
+        return cpu;
+    };
+
+    // Initialize based on all the tests yet to run.
+    results.didnt_run = selected.size();
+
+    events.group_start(*this);
+
+    // Account for and print every concluded test which is next in line, or
+    // (once the group is stopping) every concluded test left.
+    auto report = [&](bool stopping) {
+        while (next_report < selected.size()) {
+            if (!concluded[selected[next_report]]) {
+                if (!stopping) {
+                    break;
+                }
+                ++next_report;
+                continue;
+            }
+
+            const auto& t = tests[selected[next_report]];
+            const auto& r = data[selected[next_report]];
+            ++next_report;
+            --results.didnt_run;
+
+            // Account for results summary.
+            switch (r.result) {
+            case stfu::test_result::DIDNT_RUN: // Not expected
+                ++results.didnt_run;
+                break;
+
+            case stfu::test_result::SKIPPED:
+                ++results.skipped;
+                break;
+
+            case stfu::test_result::PASS:
+                ++results.passed;
+                break;
+
+            case stfu::test_result::FAIL:
+                ++results.failed;
+                break;
+
+            case stfu::test_result::CRASH:
+                ++results.crashed;
+                break;
+
+            case stfu::test_result::TIMEOUT:
+                ++results.timed_out;
+                break;
+
+            case stfu::test_result::SLOW:
+                ++results.slow;
+                break;
+
+            case stfu::test_result::OUT_OF_RESOURCES:
+                ++results.out_of_resources;
+                break;
+            }
+
+            events.test_result(*this, t, r);
+        }
+    };
+
+    // Performance of earlier runs, and of this one.
+    const auto base = baseline.empty() ? stfu_private::baseline{} :
+                      stfu_private::load_baseline(baseline, name);
+    auto measured = base;
+    auto recorded = last;
+
+    // Failures so far, towards stopping early.
+    std::size_t failures = 0;
+    bool stopping = false;
+
+    // Record the result of a test, and run (and time) per-test postfixes.
+    auto conclude = [&](std::size_t i, const test_result_data& r) {
+        const auto before_each = data[i].phases.before_each;
+
+        data[i] = r;
+        data[i].phases.before_each = before_each;
+        concluded[i] = true;
+
+        judge(tests[i], data[i], base);
+        if (test_result::PASS == data[i].result ||
+            test_result::SLOW == data[i].result) {
+            measured[tests[i].get_name()] = stfu_private::measure_of(data[i]);
+        }
+
+        recorded[tests[i].get_name()] = stfu_private::cached{
+                stfu_private::binary_key(),
+                stfu_private::result_name(data[i].result),
+                data[i].runtime.count()};
+
+        switch (data[i].result) {
+        case test_result::FAIL:
+        case test_result::CRASH:
+        case test_result::TIMEOUT:
+        case test_result::SLOW:
+        case test_result::OUT_OF_RESOURCES:
+            stopping = stopping ||
+                       (0 != max_failures && ++failures >= max_failures);
+            break;
+        default:
+            break;
+        }
+
+        const auto t1 = steady_clock::now();
+        run_fixtures(after_each, "after_each");
+        data[i].phases.after_each = duration_cast<test::seconds>(
+                steady_clock::now() - t1);
+
+        report(false);
+    };
+
+    // Within a suite, every running test but the first holds a token.
+    std::size_t held = 0;
+
+    auto slot = [&]() {
+        if (nullptr == tokens || running.size() <= held) {
+            return true;
+        }
+        if (!tokens->acquire()) {
+            return false;
+        }
+        ++held;
+        return true;
+    };
+
+    auto settle = [&]() {
+        while (held > 0 && held >= running.size()) {
+            tokens->release();
+            --held;
+        }
+    };
+
+    // Kill whatever is still running.
+    auto abandon = [&]() {
+        for (auto &rt: running) {
+            if (std::string::npos == rt.worker) {
+                ::kill(rt.child.pid, SIGKILL);
+                tests[rt.index].reap(rt.child, test::deadline::max(), rt.rx);
+            }
+            if (-1 != rt.output) {
+                ::close(rt.output);
+            }
+        }
+        running.clear();
+        settle();
+
+        for (auto &w: workers) {
+            stop_worker(w);
+        }
+    };
+
+    try {
+
+        // Set up arenas before any child (or worker) is forked.
+        for (const auto a: arenas) {
+            if (!a->map()) {
+                throw stfu_private::fixture_exception(
+                        ("arena " + a->get_name()).c_str());
+            }
+        }
+
+        // Run global prefixes.
+        run_fixtures(before_all, "before_all");
+
+        while (next_report < selected.size()) {
+
+            // Start as many tests as the job count allows.
+            while (!stopping && next_run < selected.size() &&
+                   running.size() < max_jobs && slot()) {
+                const std::size_t i = order[next_run++];
+                const auto &t = tests[i];
+
+                // Run (and time) per-test prefixes.
+                const auto t1 = steady_clock::now();
+                run_fixtures(before_each, "before_each");
+                data[i].phases.before_each = duration_cast<test::seconds>(
+                        steady_clock::now() - t1);
+
+                events.test_start(*this, t);
+
+                // Disabled tests conclude without a child process.
+                if (!t.is_enabled()) {
+                    conclude(i, t());
+                    continue;
+                }
+
+                const auto m = t.mode_in(mode);
+
+                if (execution_mode::IN_PROCESS == m) {
+                    // A crash would take the unreported results with it.
+                    events.flush();
+                    conclude(i, capture ? run_captured(t) :
+                                          t.run_in_process(settings_for(t)));
+                    continue;
+                }
+
+                auto start = steady_clock::now();
+                const auto limit = t.deadline_for(timeout);
+                std::size_t w = std::string::npos;
+                test::execution child;
+                int output[2] = { -1, -1 };
+                test::seconds forking{0};
+                int cpu = -1;
+
+                if (execution_mode::BATCHED == m) {
+                    w = dispatch(workers, i, forking);
+                    if (std::string::npos != w) {
+                        child.pid = workers[w].pid;
+                    }
+                } else {
+                    if (capture && capture_dir.empty()) {
+                        if (0 != ::pipe(output)) {
+                            output[0] = output[1] = -1;
+                        }
+                    } else if (capture) {
+                        output[1] = open_capture(t);
+                    }
+
+                    auto settings = settings_for(t);
+                    if (!cpus.empty() && t.get_placement().cpus.empty()) {
+                        cpu = pick_cpu();
+                        settings.place.cpus.assign(1, cpu);
+                    }
+
+                    t.spawn(child, forking, output[1], settings);
+
+                    if (-1 != output[1]) {
+                        ::close(output[1]);
+                    }
+                }
+
+                if (-1 == child.pid) {
+                    if (-1 != output[0]) {
+                        ::close(output[0]);
+                    }
+                    test_result_data r;
+                    r.runtime = duration_cast<duration<double>>(
+                            steady_clock::now() - start);
+                    conclude(i, r);
+                    continue;
+                }
+
+                running.push_back(running_test{i, std::move(child), start,
+                        limit, w, {}, output[0],
+                        stfu_private::ring{capture_limit}, forking, cpu});
+            }
+
+            settle();
+
+            // Once enough tests have failed, the rest are not run.
+            if (stopping) {
+                abandon();
+                report(true);
+                break;
+            }
+
+            if (running.empty()) {
+                continue;
+            }
+
+            auto output_of = [&](const running_test& rt) {
+                return (std::string::npos == rt.worker) ?
+                        rt.output : workers[rt.worker].output;
+            };
+
+            // Wait for at least one running test to write its result or
+            // terminate, either of which makes its pipe readable, or for
+            // the earliest deadline to pass. Each test's output pipe (if
+            // any) follows its result pipe.
+            std::vector<pollfd> fds;
+            auto earliest = test::deadline::max();
+            for (const auto &rt: running) {
+                const int fd = (std::string::npos == rt.worker) ?
+                        rt.child.filedes[test::read_end] :
+                        workers[rt.worker].channel;
+                fds.push_back(pollfd{fd, POLLIN, 0});
+                fds.push_back(pollfd{output_of(rt), POLLIN, 0});
+                earliest = std::min(earliest, rt.limit);
+            }
+
+            // Tests waiting on a token to start wait for one to return.
+            if (nullptr != tokens && next_run < selected.size() &&
+                running.size() < max_jobs && !stopping) {
+                fds.push_back(pollfd{tokens->fd(), POLLIN, 0});
+            }
+
+            const int wait = stfu_private::poll_timeout(earliest);
+            // Without poll(), nothing can be read without risking blocking
+            // past a deadline, so the group can't go on.
+            if (::poll(fds.data(), fds.size(), wait) < 0) {
+                if (EINTR == errno) {
+                    continue;
+                }
+                throw std::system_error{errno, std::generic_category(),
+                                        "poll"};
+            }
+
+            // Reap in reverse so that erasing doesn't disturb the indices
+            // still to be visited.
+            const auto now = steady_clock::now();
+            for (std::size_t j = running.size(); j-- > 0; ) {
+                auto &rt = running[j];
+                const bool readable = (0 != fds[2 * j].revents);
+                const bool batched = (std::string::npos != rt.worker);
+
+                // Retain output as it arrives, so the child never blocks.
+                if (0 != fds[2 * j + 1].revents &&
+                    !rt.tail.receive(output_of(rt)) && !batched) {
+                    ::close(rt.output);
+                    rt.output = -1;
+                }
+
+                if (!readable && now < rt.limit) {
+                    continue;
+                }
+
+                test_result_data r;
+
+                if (!batched) {
+                    // Keep receiving until the child closes its pipe.
+                    if (readable && now < rt.limit &&
+                        rt.rx.receive(fds[2 * j].fd)) {
+                        continue;
+                    }
+                    r = tests[rt.index].reap(rt.child, rt.limit, rt.rx);
+                } else if (collect(workers[rt.worker], readable, rt.limit,
+                                   rt.rx)) {
+                    r = std::move(rt.rx.data);
+                } else {
+                    continue;
+                }
+
+                // Whatever the test wrote before concluding is now waiting
+                // in its output pipe.
+                if (-1 != output_of(rt)) {
+                    rt.tail.drain(output_of(rt));
+                }
+
+                if (!batched && -1 != rt.output) {
+                    ::close(rt.output);
+                } else if (batched && -1 == workers[rt.worker].pid &&
+                           -1 != workers[rt.worker].output) {
+                    ::close(workers[rt.worker].output);
+                    workers[rt.worker].output = -1;
+                }
+
+                const std::size_t i = rt.index;
+                if (capture) {
+                    finish_capture(tests[i], rt.tail, r);
+                }
+
+                r.runtime = duration_cast<duration<double>>(
+                        steady_clock::now() - rt.start);
+                r.phases.fork = rt.forking;
+                running.erase(running.begin() + j);
+                conclude(i, r);
+            }
+
+            settle();
+        }
+
+        for (auto &w: workers) {
+            stop_worker(w);
+        }
+
+        // Run global postfixes.
+        run_fixtures(after_all, "after_all");
+
+        if (update_baseline && !baseline.empty() &&
+            !stfu_private::save_baseline(baseline, name, measured)) {
+            events.error(*this, "unable to update baseline: " + baseline);
+        }
+
+        if (!cache.empty() &&
+            !stfu_private::save_history(cache, name, recorded)) {
+            events.error(*this, "unable to update cache: " + cache);
+        }
+    }
+
+    catch (stfu_private::fixture_exception& e) {
+
+        // Abandon any tests still in flight; they're reported as not run.
+        abandon();
+
+        events.error(*this, std::string{"failure in fixture: "} + e.what());
+    }
+
+    catch (std::system_error& e) {
+        abandon();
+
+        events.error(*this, std::string{"failure in scheduling: "} +
+                            e.what());
+    }
+
+    events.summary(*this, results);
+
+    return results;
+}
+
+//
+// reporter implementations
+//
+
+STFU_INLINE
+stfu::stream_reporter::stream_reporter(std::ostream& o) noexcept:
+    out(o), flushed{std::chrono::steady_clock::now()}
+{
+}
+
+STFU_INLINE stfu::stream_reporter&
+stfu::stream_reporter::set_flush_interval(test::seconds t) noexcept
+{
+    flush_interval = t;
+    return *this;
+}
+
+STFU_INLINE void
+stfu::stream_reporter::flush()
+{
+    out.flush();
+    flushed = std::chrono::steady_clock::now();
+}
+
+//
+// Account for having written an event, flushing if it's due.
+//
+STFU_INLINE void
+stfu::stream_reporter::wrote()
+{
+    if (std::chrono::steady_clock::now() - flushed >= flush_interval) {
+        flush();
+    }
+}
+
+STFU_INLINE
+stfu::text_reporter::text_reporter(std::ostream& o) noexcept:
+    stream_reporter{o}
+{
+}
+
+STFU_INLINE void
+stfu::text_reporter::group_start(const test_group& g)
+{
+    if (g.verbose) {
+        out << "#" << '\n'
+            << "# STFU version " STFU_VERSION << '\n'
+            << "#" << '\n'
+            << "# Running " << g.get_test_count() << " test(s) "
+            << "in group: " << g.get_name() << '\n';
+
+        out << "#" << '\n'
+            << "# " << g.get_description() << '\n'
+            << "#" << '\n';
+    }
+
+    wrote();
+}
+
+STFU_INLINE void
+stfu::text_reporter::test_result(const test_group& g, const test& t,
+                                 const test_result_data& r)
+{
+    if (g.verbose) {
+        stfu_private::widthstream wrapped_comment{75, out};
+
+        out << "# " << t.get_name() << ": " << '\n';
+        wrapped_comment << t.get_description() << '\n'
+                        << '\n';
+    }
+
+    out << std::setw(20) << std::left << t.get_name()
+        << r
+        << " - in " << r.runtime.count() << "s";
+
+    if (g.usage && test_result::SKIPPED != r.result &&
+        test_result::DIDNT_RUN != r.result) {
+        out << " [" << r.usage << "]";
+
+        if (stfu_private::counting_allocations()) {
+            out << " [" << r.allocations << "]";
+        }
+    }
+
+    if (g.counters && test_result::SKIPPED != r.result &&
+        test_result::DIDNT_RUN != r.result) {
+        out << " [" << r.counters << "]";
+    }
+
+    out << '\n';
+
+    if (g.phases && test_result::SKIPPED != r.result &&
+        test_result::DIDNT_RUN != r.result) {
+        out << "#   phases: fork " << r.phases.fork.count()
+            << "s, body " << r.phases.body.count()
+            << "s, reap " << r.phases.reap.count()
+            << "s, before_each " << r.phases.before_each.count()
+            << "s, after_each " << r.phases.after_each.count()
+            << "s" << '\n';
+    }
+
+    for (const auto &n: r.notes) {
+        out << "#   " << n << '\n';
+    }
+
+    for (const auto &m: r.metrics) {
+        out << "#   " << m.first << " = " << m.second << '\n';
+    }
+
+    for (const auto &a: r.annotations) {
+        out << "#   " << a.first << ": " << a.second << '\n';
+    }
+
+    const bool passed = (test_result::PASS == r.result ||
+                         test_result::SKIPPED == r.result);
+
+    if (0 != r.output_size && (g.verbose || !passed)) {
+        out << "# Output";
+        if (r.output.size() < r.output_size) {
+            out << " (last " << r.output.size() << " of "
+                << r.output_size << " bytes)";
+        }
+        if (!r.output_file.empty()) {
+            out << " in " << r.output_file;
+        }
+        out << ":" << '\n';
+
+        std::size_t pos = 0;
+        while (pos < r.output.size()) {
+            auto end = r.output.find('\n', pos);
+            if (std::string::npos == end) {
+                end = r.output.size();
+            }
+            out << "# | " << r.output.substr(pos, end - pos) << '\n';
+            pos = end + 1;
+        }
+    }
+
+    if (g.verbose) {
+        out << '\n';
+    }
+
+    wrote();
+}
+
+STFU_INLINE void
+stfu::text_reporter::error(const test_group&, const std::string& what)
+{
+    out << "# ERROR - " << what << '\n';
+
+    flush();
+}
+
+STFU_INLINE void
+stfu::text_reporter::summary(const test_group& g,
+                             const test_result_summary& results)
+{
+    if (g.verbose) {
+        std::size_t failures = results.failed + results.crashed +
+                               results.timed_out + results.out_of_resources;
+
+        out << "# Summary: " << g.get_name() << " completed with "
+            << failures << ((1 == failures) ? " failure" : " failures");
+
+        if (0 != results.slow) {
+            out << " (" << results.slow << " slow)";
+        }
+
+        if (0 != results.didnt_run) {
+            out << ", " << results.didnt_run << " not run";
+        }
+
+        out << '\n';
+    }
+
+    flush();
+}
+
+STFU_INLINE
+stfu::json_reporter::json_reporter(std::ostream& o) noexcept:
+    stream_reporter{o}
+{
+}
+
+STFU_INLINE void
+stfu::json_reporter::group_start(const test_group& g)
+{
+    out << "{\"event\":\"group_start\",\"group\":"
+        << stfu_private::json_quote(g.get_name())
+        << ",\"description\":"
+        << stfu_private::json_quote(g.get_description())
+        << ",\"tests\":" << g.get_test_count() << "}" << '\n';
+
+    wrote();
+}
+
+STFU_INLINE void
+stfu::json_reporter::test_start(const test_group& g, const test& t)
+{
+    out << "{\"event\":\"test_start\",\"group\":"
+        << stfu_private::json_quote(g.get_name())
+        << ",\"test\":" << stfu_private::json_quote(t.get_name())
+        << "}" << '\n';
+
+    wrote();
+}
+
+STFU_INLINE void
+stfu::json_reporter::test_result(const test_group& g, const test& t,
+                                 const test_result_data& r)
+{
+    using stfu_private::json_quote;
+
+    const auto &u = r.usage;
+    const auto &p = r.phases;
+    const char* sep = "";
+    std::ostringstream line;
+
+    line << std::setprecision(9)
+         << "{\"event\":\"test_result\",\"group\":"
+         << json_quote(g.get_name())
+         << ",\"test\":" << json_quote(t.get_name())
+         << ",\"result\":\"" << stfu_private::result_name(r.result) << "\""
+         << ",\"message\":" << json_quote(r.message)
+         << ",\"runtime\":" << r.runtime.count();
+
+    line << ",\"notes\":[";
+    for (const auto &n: r.notes) {
+        line << sep << json_quote(n);
+        sep = ",";
+    }
+
+    line << "],\"metrics\":{";
+    sep = "";
+    for (const auto &m: r.metrics) {
+        // JSON has no representation of non-finite numbers.
+        line << sep << json_quote(m.first) << ":";
+        if (std::isfinite(m.second)) {
+            line << m.second;
+        } else {
+            line << "null";
+        }
+        sep = ",";
+    }
+
+    line << "},\"annotations\":{";
+    sep = "";
+    for (const auto &a: r.annotations) {
+        line << sep << json_quote(a.first) << ":" << json_quote(a.second);
+        sep = ",";
+    }
+
+    line << "},\"usage\":{\"utime\":" << u.user.count()
+         << ",\"stime\":" << u.system.count()
+         << ",\"maxrss\":" << u.max_rss
+         << ",\"minflt\":" << u.minor_faults
+         << ",\"majflt\":" << u.major_faults
+         << ",\"nvcsw\":" << u.voluntary_switches
+         << ",\"nivcsw\":" << u.involuntary_switches
+         << "},\"phases\":{\"fork\":" << p.fork.count()
+         << ",\"body\":" << p.body.count()
+         << ",\"reap\":" << p.reap.count()
+         << ",\"before_each\":" << p.before_each.count()
+         << ",\"after_each\":" << p.after_each.count()
+         << "},\"allocations\":{\"allocs\":" << r.allocations.allocations
+         << ",\"frees\":" << r.allocations.deallocations
+         << ",\"bytes\":" << r.allocations.bytes << "}";
+
+    // Counters, those which were counted, if any.
+    const auto &c = r.counters;
+    const std::pair<const char*, long long> counters[] = {
+        { "cycles", c.cycles },
+        { "instructions", c.instructions },
+        { "cache_references", c.cache_references },
+        { "cache_misses", c.cache_misses },
+        { "branch_misses", c.branch_misses },
+        { "task_clock_ns", c.task_clock },
+    };
+    const char* prefix = ",\"counters\":{";
+
+    for (const auto &f: counters) {
+        if (0 <= f.second) {
+            line << prefix << "\"" << f.first << "\":" << f.second;
+            prefix = ",";
+        }
+    }
+    if (',' == prefix[0] && '\0' == prefix[1]) {
+        line << "}";
+    }
+
+    if (0 != r.output_size) {
+        line << ",\"output\":" << json_quote(r.output)
+             << ",\"output_size\":" << r.output_size;
+        if (!r.output_file.empty()) {
+            line << ",\"output_file\":" << json_quote(r.output_file);
+        }
+    }
+
+    line << "}";
+    out << line.str() << '\n';
+
+    wrote();
+}
+
+STFU_INLINE void
+stfu::json_reporter::error(const test_group& g, const std::string& what)
+{
+    out << "{\"event\":\"error\",\"group\":"
+        << stfu_private::json_quote(g.get_name())
+        << ",\"message\":" << stfu_private::json_quote(what)
+        << "}" << '\n';
+
+    flush();
+}
+
+STFU_INLINE void
+stfu::json_reporter::summary(const test_group& g,
+                             const test_result_summary& results)
+{
+    out << "{\"event\":\"summary\",\"group\":"
+        << stfu_private::json_quote(g.get_name())
+        << ",\"didnt_run\":" << results.didnt_run
+        << ",\"skipped\":" << results.skipped
+        << ",\"passed\":" << results.passed
+        << ",\"failed\":" << results.failed
+        << ",\"crashed\":" << results.crashed
+        << ",\"timed_out\":" << results.timed_out
+        << ",\"slow\":" << results.slow
+        << ",\"out_of_resources\":" << results.out_of_resources << "}"
+        << '\n';
+
+    flush();
+}
+
+STFU_INLINE
+stfu::junit_reporter::junit_reporter(std::ostream& o):
+    stream_reporter{o}
+{
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << '\n'
+        << "<testsuites>" << '\n';
+}
+
+STFU_INLINE
+stfu::junit_reporter::~junit_reporter()
+{
+    try {
+        out << "</testsuites>" << std::endl;
+    } catch (...) {
+    }
+}
+
+STFU_INLINE void
+stfu::junit_reporter::group_start(const test_group& g)
+{
+    out << "  <testsuite name=" << stfu_private::xml_quote(g.get_name())
+        << ">" << '\n';
+
+    wrote();
+}
+
+STFU_INLINE void
+stfu::junit_reporter::test_result(const test_group& g, const test& t,
+                                  const test_result_data& r)
+{
+    using stfu_private::xml_quote;
+
+    out << "    <testcase classname=" << xml_quote(g.get_name())
+        << " name=" << xml_quote(t.get_name())
+        << " time=\"" << r.runtime.count() << "\">" << '\n';
+
+    switch (r.result) {
+    case test_result::PASS:
+        break;
+
+    case test_result::DIDNT_RUN:
+    case test_result::SKIPPED:
+        out << "      <skipped/>" << '\n';
+        break;
+
+    case test_result::FAIL:
+    case test_result::SLOW:
+        out << "      <failure type=\"" << stfu_private::result_name(r.result)
+            << "\" message=" << xml_quote(r.message) << "/>" << '\n';
+        break;
+
+    case test_result::CRASH:
+    case test_result::TIMEOUT:
+    case test_result::OUT_OF_RESOURCES:
+        out << "      <error type=\"" << stfu_private::result_name(r.result)
+            << "\" message=" << xml_quote(r.message) << "/>" << '\n';
+        break;
+    }
+
+    if (!r.metrics.empty() || !r.annotations.empty()) {
+        out << "      <properties>" << '\n';
+        for (const auto &m: r.metrics) {
+            out << "        <property name=" << xml_quote(m.first)
+                << " value=\"" << m.second << "\"/>" << '\n';
+        }
+        for (const auto &a: r.annotations) {
+            out << "        <property name=" << xml_quote(a.first)
+                << " value=" << xml_quote(a.second) << "/>" << '\n';
+        }
+        out << "      </properties>" << '\n';
+    }
+
+    if (!r.notes.empty() || 0 != r.output_size) {
+        std::string text;
+        for (const auto &n: r.notes) {
+            text.append(n).append("\n");
+        }
+        text.append(r.output);
+
+        // Quoted as an attribute, then unwrapped as element content.
+        const std::string quoted = xml_quote(text);
+        out << "      <system-out>" << quoted.substr(1, quoted.size() - 2)
+            << "</system-out>" << '\n';
+    }
+
+    out << "    </testcase>" << '\n';
+
+    wrote();
+}
+
+STFU_INLINE void
+stfu::junit_reporter::error(const test_group&, const std::string& what)
+{
+    const std::string quoted = stfu_private::xml_quote(what);
+    out << "    <system-err>" << quoted.substr(1, quoted.size() - 2)
+        << "</system-err>" << '\n';
+
+    flush();
+}
+
+STFU_INLINE void
+stfu::junit_reporter::summary(const test_group&, const test_result_summary&)
+{
+    out << "  </testsuite>" << '\n';
+
+    flush();
+}
+
+STFU_INLINE
+stfu::tap_reporter::tap_reporter(std::ostream& o):
+    stream_reporter{o}
+{
+    out << "TAP version 13" << '\n';
+}
+
+STFU_INLINE
+stfu::tap_reporter::~tap_reporter()
+{
+    try {
+        out << "1.." << count << std::endl;
+    } catch (...) {
+    }
+}
+
+STFU_INLINE void
+stfu::tap_reporter::group_start(const test_group& g)
+{
+    out << "# " << g.get_name() << ": " << g.get_description() << '\n';
+
+    wrote();
+}
+
+STFU_INLINE void
+stfu::tap_reporter::test_result(const test_group&, const test& t,
+                                const test_result_data& r)
+{
+    const bool ok = (test_result::PASS == r.result ||
+                     test_result::SKIPPED == r.result);
+
+    out << (ok ? "ok " : "not ok ") << ++count << " - " << t.get_name();
+
+    if (test_result::SKIPPED == r.result) {
+        out << " # SKIP";
+    }
+
+    out << '\n';
+
+    if (!ok) {
+        out << "  ---" << '\n'
+            << "  result: " << stfu_private::result_name(r.result)
+            << '\n'
+            << "  message: " << stfu_private::json_quote(r.message)
+            << '\n'
+            << "  runtime: " << r.runtime.count() << '\n';
+        if (0 != r.output_size) {
+            out << "  output: " << stfu_private::json_quote(r.output)
+                << '\n';
+        }
+        out << "  ..." << '\n';
+    }
+
+    wrote();
+}
+
+STFU_INLINE void
+stfu::tap_reporter::error(const test_group&, const std::string& what)
+{
+    out << "# ERROR - " << what << '\n';
+
+    flush();
+}
+
+//
+// test_suite implementation
+//
+
+STFU_INLINE
+stfu::test_suite::test_suite() noexcept:
+    factory{[](std::ostream& o) {
+        return std::unique_ptr<reporter>{new text_reporter{o}};
+    }}
+{
+    unsigned long count;
+
+    if (stfu_private::getenv("STFU_JOBS", count)) {
+        jobs = count;
+    }
+}
+
+//
+// Number of tests which may run at once across all the groups; 0 means one
+// per online CPU (the default, unless STFU_JOBS is set).
+//
+STFU_INLINE stfu::test_suite&
+stfu::test_suite::set_jobs(std::size_t n) noexcept
+{
+    jobs = n;
+    return *this;
+}
+
+//
+// Report each group with a reporter made by the given function, writing to
+// the group's buffer; text by default.
+//
+STFU_INLINE stfu::test_suite&
+stfu::test_suite::set_reporter(reporter_factory f)
+{
+    factory = std::move(f);
+    return *this;
+}
+
+STFU_INLINE stfu::test_suite&
+stfu::test_suite::add_group(const test_group& g)
+{
+    groups.push_back(g);
+    return *this;
+}
+
+STFU_INLINE stfu::test_suite&
+stfu::test_suite::add_group(test_group&& g)
+{
+    groups.push_back(std::move(g));
+    return *this;
+}
+
+STFU_INLINE std::size_t
+stfu::test_suite::get_jobs() const noexcept
+{
+    if (0 == jobs) {
+        long n = ::sysconf(_SC_NPROCESSORS_ONLN);
+        return (n > 0) ? static_cast<std::size_t>(n) : 1;
+    }
+
+    return jobs;
+}
+
+STFU_INLINE std::size_t
+stfu::test_suite::get_group_count() const noexcept
+{
+    return groups.size();
+}
+
+//
+// Run every group, each in a child process which reports to a buffer and,
+// as it exits, sends its results back (a line of the summary's counts) and
+// then its report, which is written out whole.
+//
+STFU_INLINE stfu::test_result_summary
+stfu::test_suite::operator()() const
+{
+    return (*this)(std::cout);
+}
+
+STFU_INLINE stfu::test_result_summary
+stfu::test_suite::operator()(std::ostream& out) const
+{
+    struct running_group {
+        std::size_t index;
+        pid_t pid;
+        int fd;
+        std::string received;
+    };
+
+    const stfu_private::jobserver tokens{get_jobs()};
+    std::vector<running_group> running;
+    std::size_t next = 0;
+    test_result_summary results;
+
+    auto add = [&results](const test_result_summary& r) {
+        results.didnt_run += r.didnt_run;
+        results.skipped += r.skipped;
+        results.passed += r.passed;
+        results.failed += r.failed;
+        results.crashed += r.crashed;
+        results.timed_out += r.timed_out;
+        results.slow += r.slow;
+        results.out_of_resources += r.out_of_resources;
+    };
+
+    auto run = [this, &tokens](std::size_t i, std::ostream& o) {
+        test_group g = groups[i];
+        g.tokens = tokens.valid() ? &tokens : nullptr;
+        return g(*factory(o));
+    };
+
+    // Without a jobserver (or a pipe for a group), groups run here, in turn.
+    auto run_here = [&](std::size_t i) {
+        std::ostringstream buffer;
+        add(run(i, buffer));
+        out << buffer.str();
+        out.flush();
+    };
+
+    auto finish = [&](running_group& g) {
+        int stat_loc;
+        while (::waitpid(g.pid, &stat_loc, 0) < 0 && EINTR == errno) {
+        }
+        ::close(g.fd);
+        tokens.release();
+
+        const auto eol = g.received.find('\n');
+        std::istringstream counts{g.received.substr(0, eol)};
+        test_result_summary r;
+
+        if (std::string::npos != eol &&
+            counts >> r.didnt_run >> r.skipped >> r.passed >> r.failed
+                   >> r.crashed >> r.timed_out >> r.slow
+                   >> r.out_of_resources) {
+            out << g.received.substr(eol + 1);
+        } else {
+            // The group's process died; hold all its tests responsible.
+            r.crashed = groups[g.index].get_test_count();
+            out << "# ERROR - " << groups[g.index].get_name()
+                << ": terminated abnormally\n";
+        }
+
+        out.flush();
+        add(r);
+    };
+
+    if (!tokens.valid()) {
+        for (std::size_t i = 0; i < groups.size(); ++i) {
+            run_here(i);
+        }
+        return results;
+    }
+
+    while (next < groups.size() || !running.empty()) {
+
+        // Each group takes a token to start, for its first running test.
+        while (next < groups.size() && tokens.acquire()) {
+            const std::size_t i = next++;
+            int fds[2];
+
+            if (0 != ::pipe(fds)) {
+                run_here(i);
+                tokens.release();
+                continue;
+            }
+
+            out.flush();
+            stfu_private::flush_stdio();
+
+            const pid_t pid = ::fork();
+
+            if (0 == pid) {
+                ::close(fds[0]);
+
+                std::ostringstream buffer;
+                const auto r = run(i, buffer);
+                std::ostringstream message;
+
+                message << r.didnt_run << ' ' << r.skipped << ' ' << r.passed
+                        << ' ' << r.failed << ' ' << r.crashed << ' '
+                        << r.timed_out << ' ' << r.slow << ' '
+                        << r.out_of_resources << '\n'
+                        << buffer.str();
+
+                const std::string m = message.str();
+                for (std::size_t sent = 0; sent < m.size(); ) {
+                    const ssize_t n = ::write(fds[1], m.data() + sent,
+                                              m.size() - sent);
+                    if (n < 0 && EINTR == errno) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        break;
+                    }
+                    sent += n;
+                }
+
+                ::close(fds[1]);
+                ::exit(0);
+            }
+
+            ::close(fds[1]);
+
+            if (-1 == pid) {
+                ::close(fds[0]);
+                run_here(i);
+                tokens.release();
+                continue;
+            }
+
+            running.push_back(running_group{i, pid, fds[0], {}});
+        }
+
+        if (running.empty()) {
+            continue;
+        }
+
+        // Wait for a group to send something (or exit), or for a token to
+        // return while groups wait to start.
+        std::vector<pollfd> fds;
+        for (const auto &g: running) {
+            fds.push_back(pollfd{g.fd, POLLIN, 0});
+        }
+        if (next < groups.size()) {
+            fds.push_back(pollfd{tokens.fd(), POLLIN, 0});
+        }
+
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            // Without poll(), reading might block indefinitely: kill the
+            // running groups (held responsible as terminated abnormally),
+            // and run the rest here, in turn.
+            for (auto &g: running) {
+                ::kill(g.pid, SIGKILL);
+                g.received.clear();
+                finish(g);
+            }
+            running.clear();
+
+            while (next < groups.size()) {
+                run_here(next++);
+            }
+            break;
+        }
+
+        for (std::size_t j = running.size(); j-- > 0; ) {
+            if (0 == fds[j].revents) {
+                continue;
+            }
+
+            char buffer[4096];
+            const ssize_t n = ::read(running[j].fd, buffer, sizeof buffer);
+
+            if (n > 0) {
+                running[j].received.append(buffer, n);
+            } else if (0 == n || EINTR != errno) {
+                finish(running[j]);
+                running.erase(running.begin() + j);
+            }
+        }
+    }
+
+    return results;
+}
+
+STFU_INLINE int
+stfu::exit_status(const test_result_summary& r) noexcept
+{
+    return (0 != r.failed || 0 != r.crashed || 0 != r.timed_out ||
+            0 != r.slow || 0 != r.out_of_resources) ? 1 : 0;
+}
+
+//
+// registry implementation
+//
+
+STFU_INLINE std::vector<stfu::registered_test>&
+stfu::registry() noexcept
+{
+    static std::vector<registered_test> tests;
+    return tests;
+}
+
+STFU_INLINE bool
+stfu::start_zygote()
+{
+    return stfu_private::zygote::instance().start();
+}
+
+STFU_INLINE void
+stfu::stop_zygote() noexcept
+{
+    stfu_private::zygote::instance().stop();
+}
+
+STFU_INLINE bool
+stfu::exclude_from_fork(const void* p, std::size_t n) noexcept
+{
+#if defined(MADV_DONTFORK)
+    return stfu_private::advise_pages(p, n, MADV_DONTFORK);
+#else
+    (void) p;
+    (void) n;
+    return false;
+#endif
+}
+
+STFU_INLINE bool
+stfu::include_in_fork(const void* p, std::size_t n) noexcept
+{
+#if defined(MADV_DOFORK)
+    return stfu_private::advise_pages(p, n, MADV_DOFORK);
+#else
+    (void) p;
+    (void) n;
+    return false;
+#endif
+}
+
+STFU_INLINE int
+stfu::run_main(int argc, const char* const* argv)
+{
+    return run_main(argc, argv, std::cout);
+}
+
+STFU_INLINE int
+stfu::run_main(int argc, const char* const* argv, std::ostream& out)
+{
+    std::vector<std::string> filters;
+    std::vector<std::string> tags;
+    std::vector<std::string> excluded_tags;
+    std::unique_ptr<reporter> report{new text_reporter{out}};
+    bool list = false;
+    bool verbose = false;
+    std::size_t jobs = 0;
+    bool set_jobs = false;
+    std::size_t shard_index = 0;
+    std::size_t shard_count = 0;
+    std::string shard_weights;
+    std::size_t max_failures = 0;
+    std::string cache;
+    bool failed_first = false;
+    bool only_failed = false;
+    auto policy = schedule_policy::DECLARED;
+
+    // The failure limit spans all the groups, unlike the rest of the
+    // environment's defaults.
+    unsigned long limit;
+    if (stfu_private::getenv("STFU_MAX_FAILURES", limit)) {
+        max_failures = limit;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg{argv[i]};
+        const bool value = (i + 1 < argc);
+
+        if ("--list" == arg) {
+            list = true;
+        } else if ("--verbose" == arg) {
+            verbose = true;
+        } else if ("--filter" == arg && value) {
+            filters.push_back(argv[++i]);
+        } else if ("--tag" == arg && value) {
+            tags.push_back(argv[++i]);
+        } else if ("--exclude-tag" == arg && value) {
+            excluded_tags.push_back(argv[++i]);
+        } else if ("--jobs" == arg && value) {
+            jobs = std::strtoul(argv[++i], nullptr, 10);
+            set_jobs = true;
+        } else if ("--cache" == arg && value) {
+            cache = argv[++i];
+        } else if ("--failed-first" == arg) {
+            failed_first = true;
+        } else if ("--only-failed" == arg) {
+            only_failed = true;
+        } else if ("--longest-first" == arg) {
+            policy = schedule_policy::LONGEST_FIRST;
+        } else if ("--fail-fast" == arg) {
+            max_failures = 1;
+        } else if ("--max-failures" == arg && value) {
+            max_failures = std::strtoul(argv[++i], nullptr, 10);
+        } else if ("--shard-index" == arg && value) {
+            shard_index = std::strtoul(argv[++i], nullptr, 10);
+        } else if ("--shard-count" == arg && value) {
+            shard_count = std::strtoul(argv[++i], nullptr, 10);
+        } else if ("--shard-weights" == arg && value) {
+            shard_weights = argv[++i];
+        } else if ("--format" == arg && value) {
+            const std::string format{argv[++i]};
+
+            if ("json" == format) {
+                report.reset(new json_reporter{out});
+            } else if ("junit" == format) {
+                report.reset(new junit_reporter{out});
+            } else if ("tap" == format) {
+                report.reset(new tap_reporter{out});
+            } else if ("text" != format) {
+                std::cerr << "Unknown format: " << format << std::endl;
+                return 2;
+            }
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--list] [--verbose]"
+                      << " [--filter GLOB]... [--tag TAG]..."
+                      << " [--exclude-tag TAG]... [--jobs N]"
+                      << " [--fail-fast | --max-failures N]"
+                      << " [--cache FILE [--failed-first] [--only-failed]"
+                      << " [--longest-first]]"
+                      << " [--shard-index I --shard-count N"
+                      << " [--shard-weights REPORT]]"
+                      << " [--format text|json|junit|tap]" << std::endl
+                      << "Filters match \"group.name\"; a test runs if it"
+                      << " matches any filter or has any tag given, and has"
+                      << " no excluded tag."
+                      << std::endl;
+            return ("--help" == arg) ? 0 : 2;
+        }
+    }
+
+    auto selected = [&](const registered_test& r) {
+        const std::string full = std::string{r.group} + "." + r.name;
+        bool match = filters.empty() && tags.empty();
+
+        for (const auto &f: filters) {
+            match = match || stfu_private::glob_match(f.c_str(),
+                                                      full.c_str());
+        }
+        for (const auto &t: tags) {
+            match = match || stfu_private::has_tag(r.tags, t);
+        }
+        for (const auto &t: excluded_tags) {
+            match = match && !stfu_private::has_tag(r.tags, t);
+        }
+
+        return match;
+    };
+
+    // Groups, in order of their first registered test, and their selected
+    // tests.
+    std::vector<std::pair<std::string, std::vector<const registered_test*>>>
+            groups;
+
+    for (const auto &r: registry()) {
+        if (!selected(r)) {
+            continue;
+        }
+
+        auto g = std::find_if(groups.begin(), groups.end(),
+                [&r](const decltype(groups)::value_type& e) {
+                    return e.first == r.group;
+                });
+        if (groups.end() == g) {
+            groups.emplace_back(r.group,
+                                std::vector<const registered_test*>{});
+            g = groups.end() - 1;
+        }
+        g->second.push_back(&r);
+    }
+
+    if (list) {
+        for (const auto &g: groups) {
+            for (const auto r: g.second) {
+                out << g.first << "." << r->name;
+                if ('\0' != r->tags[0]) {
+                    out << " [" << r->tags << "]";
+                }
+                out << '\n';
+            }
+        }
+        out.flush();
+        return 0;
+    }
+
+    bool failed = false;
+    std::size_t failures = 0;
+
+    for (const auto &g: groups) {
+
+        // Failures are counted towards the limit across groups.
+        if (0 != max_failures && failures >= max_failures) {
+            break;
+        }
+
+        test_group group{g.first.c_str()};
+        group.apply_environment();
+
+        for (const auto r: g.second) {
+            group.add_test(test{r->name, r->routine});
+        }
+
+        if (set_jobs) {
+            group.set_jobs(jobs);
+        }
+
+        if (0 != shard_count) {
+            group.set_shard(shard_index, shard_count);
+        }
+
+        if (!shard_weights.empty()) {
+            group.set_shard_weights(shard_weights);
+        }
+
+        if (0 != max_failures) {
+            group.set_fail_fast(max_failures - failures);
+        }
+
+        if (!cache.empty()) {
+            group.set_cache(cache);
+        }
+
+        group.set_failed_first(failed_first)
+             .set_only_failed(only_failed)
+             .set_schedule(policy);
+
+        const auto results = group.set_verbose(verbose)(*report);
+
+        failures += results.failed + results.crashed + results.timed_out +
+                    results.slow + results.out_of_resources;
+        failed = failed || 0 != failures;
+    }
+
+    return failed ? 1 : 0;
+}
+
+STFU_INLINE
+stfu_private::registrar::registrar(const stfu::registered_test& r)
+{
+    stfu::registry().push_back(r);
+}
+
+STFU_INLINE bool
+stfu_private::glob_match(const char* pattern, const char* text) noexcept
+{
+    // Where to resume after the last "*", should the match fail.
+    const char* star = nullptr;
+    const char* resume = nullptr;
+
+    while ('\0' != *text) {
+        if ('*' == *pattern) {
+            star = pattern++;
+            resume = text;
+        } else if ('?' == *pattern || *pattern == *text) {
+            ++pattern;
+            ++text;
+        } else if (nullptr != star) {
+            pattern = star + 1;
+            text = ++resume;
+        } else {
+            return false;
+        }
+    }
+
+    while ('*' == *pattern) {
+        ++pattern;
+    }
+
+    return '\0' == *pattern;
+}
+
+//
+// 64-bit FNV-1a.
+//
+STFU_INLINE std::uint64_t
+stfu_private::stable_hash(const std::string& text) noexcept
+{
+    std::uint64_t h = 14695981039346656037ull;
+
+    for (const unsigned char c: text) {
+        h = (h ^ c) * 1099511628211ull;
+    }
+
+    return h;
+}
+
+STFU_INLINE bool
+stfu_private::json_fields(const std::string& text,
+                          std::map<std::string, std::string>& fields)
+{
+    std::size_t pos = 0;
+
+    auto space = [&]() {
+        while (pos < text.size() &&
+               std::isspace(static_cast<unsigned char>(text[pos]))) {
+            ++pos;
+        }
+    };
+
+    auto string = [&](std::string& value) {
+        if (pos >= text.size() || '"' != text[pos]) {
+            return false;
+        }
+
+        for (++pos; pos < text.size() && '"' != text[pos]; ++pos) {
+            char c = text[pos];
+
+            if ('\\' == c && ++pos < text.size()) {
+                switch (c = text[pos]) {
+                case 'n':
+                    c = '\n';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case 'u':
+                    // Only as written by json_quote(), for control codes.
+                    c = static_cast<char>(std::strtol(
+                            text.substr(pos + 1, 4).c_str(), nullptr, 16));
+                    pos += 4;
+                    break;
+                }
+            }
+
+            value += c;
+        }
+
+        return pos++ < text.size();
+    };
+
+    // Any other value, as its text; of objects and arrays, just their
+    // extent is found.
+    auto other = [&](std::string& value) {
+        std::size_t depth = 0;
+        std::string ignored;
+
+        while (pos < text.size()) {
+            const char c = text[pos];
+
+            if ('"' == c) {
+                if (!string(ignored)) {
+                    return false;
+                }
+                continue;
+            }
+
+            if ('{' == c || '[' == c) {
+                ++depth;
+            } else if ('}' == c || ']' == c) {
+                if (0 == depth) {
+                    break;
+                }
+                --depth;
+            } else if (',' == c && 0 == depth) {
+                break;
+            } else if (0 == depth) {
+                value += c;
+            }
+
+            ++pos;
+        }
+
+        return true;
+    };
+
+    space();
+    if (pos >= text.size() || '{' != text[pos++]) {
+        return false;
+    }
+
+    for (;;) {
+        std::string key, value;
+
+        space();
+        if (pos < text.size() && '}' == text[pos]) {
+            return true;
+        }
+
+        if (!string(key)) {
+            return false;
+        }
+
+        space();
+        if (pos >= text.size() || ':' != text[pos++]) {
+            return false;
+        }
+
+        space();
+        if (pos < text.size() && '"' == text[pos] ? !string(value) :
+                                                     !other(value)) {
+            return false;
+        }
+        fields[key] = value;
+
+        space();
+        if (pos < text.size() && ',' == text[pos]) {
+            ++pos;
+        } else {
+            return pos < text.size() && '}' == text[pos];
+        }
+    }
+}
+
+STFU_INLINE std::map<std::string, double>
+stfu_private::load_runtimes(const std::string& path, const std::string& group)
+{
+    std::map<std::string, double> runtimes;
+    std::ifstream in{path};
+    std::string line;
+
+    while (std::getline(in, line)) {
+        std::map<std::string, std::string> fields;
+
+        if (json_fields(line, fields) &&
+            "test_result" == fields["event"] && group == fields["group"] &&
+            !fields["runtime"].empty()) {
+            runtimes[fields["test"]] = std::strtod(fields["runtime"].c_str(),
+                                                   nullptr);
+        }
+    }
+
+    return runtimes;
+}
+
+STFU_INLINE bool
+stfu_private::has_tag(const char* tags, const std::string& tag)
+{
+    const std::string separators{" ,"};
+    const std::string list{tags};
+    std::size_t pos = 0;
+
+    while (pos < list.size()) {
+        const auto end = std::min(list.find_first_of(separators, pos),
+                                  list.size());
+        if (0 == list.compare(pos, end - pos, tag) && end > pos) {
+            return true;
+        }
+        pos = end + 1;
+    }
+
+    return false;
+}
+
+STFU_INLINE const std::string&
+stfu_private::fail::get_message() const noexcept
+{
+    return message;
+}
+
+STFU_INLINE
+stfu_private::fail::fail() noexcept:
+    message{"FAILED"}
+{
+}
+
+STFU_INLINE
+stfu_private::failed_at::failed_at(const char* f, size_t l) noexcept
+{
+    message.append(" at ")
+           .append(f)
+           .append(":")
+           .append(std::to_string(l));
+}
+
+STFU_INLINE
+stfu_private::failed_assert::failed_assert(const char* f, size_t l,
+        const char* x) noexcept:
+    failed_at{f, l}
+{
+    message.append(": \"")
+           .append(x)
+           .append("\"");
+}
+
+STFU_INLINE
+stfu_private::failed_compare::failed_compare(const char* f, size_t l,
+        const char* x, const std::string& lhs, const std::string& rhs,
+        const std::string& tolerance) noexcept:
+    failed_assert{f, l, x}
+{
+    message.append(" with ")
+           .append(lhs)
+           .append(" vs. ")
+           .append(rhs);
+
+    if (!tolerance.empty()) {
+        message.append(", tolerance ")
+               .append(tolerance);
+    }
+}
+
+STFU_INLINE std::string
+stfu_private::show(std::nullptr_t)
+{
+    return "nullptr";
+}
+
+//
+// Format a value with the given function, showing booleans by name and
+// floating point values in full.
+//
+STFU_INLINE std::string
+stfu_private::format(void (*print)(std::ostream&, const void*),
+                     const void* value)
+{
+    std::ostringstream out;
+
+    out << std::boolalpha
+        << std::setprecision(std::numeric_limits<double>::max_digits10);
+    print(out, value);
+
+    return out.str();
+}
+
+STFU_INLINE
+stfu_private::fixture_exception::fixture_exception(const char *m):
+    std::runtime_error{m}
+{
+}
+
+STFU_INLINE void
+stfu::note(const std::string& text) noexcept
+{
+    stfu_private::emit(stfu_private::record::NOTE, text);
+}
+
+STFU_INLINE void
+stfu::metric(const std::string& name, double value) noexcept
+{
+    try {
+        std::string payload(sizeof(value), '\0');
+        std::memcpy(&payload[0], &value, sizeof(value));
+        stfu_private::emit(stfu_private::record::METRIC, payload + name);
+    } catch (...) {
+    }
+}
+
+STFU_INLINE void
+stfu::annotate(const std::string& key, const std::string& value) noexcept
+{
+    try {
+        stfu_private::emit(stfu_private::record::ANNOTATION,
+                           key + '\0' + value);
+    } catch (...) {
+    }
+}
+
+STFU_INLINE stfu_private::sink&
+stfu_private::current_sink() noexcept
+{
+    static sink s{-1, nullptr};
+    return s;
+}
+
+STFU_INLINE
+stfu_private::redirect::redirect(int fd) noexcept:
+    saved(current_sink())
+{
+    current_sink() = sink{fd, nullptr};
+}
+
+STFU_INLINE
+stfu_private::redirect::redirect(stfu::test_result_data& r) noexcept:
+    saved(current_sink())
+{
+    current_sink() = sink{-1, &r};
+}
+
+STFU_INLINE
+stfu_private::redirect::~redirect()
+{
+    current_sink() = saved;
+}
+
+//
+// Send a record from the running test routine. Outside of any test, records
+// are discarded.
+//
+STFU_INLINE void
+stfu_private::emit(record type, const std::string& payload) noexcept
+{
+    const sink& s = current_sink();
+
+    if (nullptr != s.local) {
+        try {
+            apply(type, payload, *s.local);
+        } catch (...) {
+        }
+    } else if (-1 != s.fd) {
+        send(s.fd, type, payload);
+    }
+}
+
+STFU_INLINE bool
+stfu_private::send(int fd, record type, const std::string& payload) noexcept
+{
+    try {
+        const std::uint32_t length = payload.size();
+        std::string frame(1 + sizeof(length), static_cast<char>(type));
+
+        std::memcpy(&frame[1], &length, sizeof(length));
+        frame.append(payload);
+
+        return write_all(fd, frame.data(), frame.size());
+    } catch (...) {
+        return false;
+    }
+}
+
+//
+// Conclude a test run in a child: its body time, then its result.
+//
+STFU_INLINE bool
+stfu_private::send_result(int fd, const stfu::test_result_data& r) noexcept
+{
+    const double body = r.phases.body.count();
+
+    try {
+        std::string payload(1, static_cast<char>(r.result));
+
+        return send(fd, record::TIMING,
+                    std::string(reinterpret_cast<const char*>(&body),
+                                sizeof(body))) &&
+               send(fd, record::ALLOCATIONS,
+                    std::string(reinterpret_cast<const char*>(&r.allocations),
+                                sizeof(r.allocations))) &&
+               send(fd, record::COUNTERS,
+                    std::string(reinterpret_cast<const char*>(&r.counters),
+                                sizeof(r.counters))) &&
+               send(fd, record::RESULT, payload.append(r.message));
+    } catch (...) {
+        return false;
+    }
+}
+
+//
+// Apply a record to a test's result. Returns false if it's a result which
+// is malformed (not one of the test_result values), which is left unapplied.
+//
+STFU_INLINE bool
+stfu_private::apply(record type, const std::string& payload,
+                    stfu::test_result_data& r)
+{
+    const auto last = stfu::test_result::OUT_OF_RESOURCES;
+
+    switch (type) {
+    case record::RESULT:
+        if (payload.empty() || static_cast<unsigned char>(payload[0]) >
+                               static_cast<unsigned char>(last)) {
+            return false;
+        }
+        r.result = static_cast<stfu::test_result>(payload[0]);
+        r.message = payload.substr(1);
+        break;
+
+    case record::NOTE:
+        r.notes.push_back(payload);
+        break;
+
+    case record::METRIC:
+        if (payload.size() >= sizeof(double)) {
+            double value;
+            std::memcpy(&value, payload.data(), sizeof(value));
+            r.metrics.emplace_back(payload.substr(sizeof(value)), value);
+        }
+        break;
+
+    case record::ANNOTATION: {
+        const auto split = payload.find('\0');
+        if (std::string::npos != split) {
+            r.annotations.emplace_back(payload.substr(0, split),
+                                       payload.substr(split + 1));
+        }
+        break;
+    }
+
+    case record::USAGE:
+        if (payload.size() == sizeof(r.usage)) {
+            std::memcpy(&r.usage, payload.data(), sizeof(r.usage));
+        }
+        break;
+
+    case record::TIMING:
+        if (payload.size() == sizeof(double)) {
+            double body;
+            std::memcpy(&body, payload.data(), sizeof(body));
+            r.phases.body = std::chrono::duration<double>{body};
+        }
+        break;
+
+    case record::ALLOCATIONS:
+        if (payload.size() == sizeof(r.allocations)) {
+            std::memcpy(&r.allocations, payload.data(),
+                        sizeof(r.allocations));
+        }
+        break;
+
+    case record::COUNTERS:
+        if (payload.size() == sizeof(r.counters)) {
+            std::memcpy(&r.counters, payload.data(), sizeof(r.counters));
+        }
+        break;
+    }
+
+    return true;
+}
+
+//
+// Read whatever is available, applying each complete record received.
+// Returns false once the other end has closed (or on error), or once a
+// malformed result is received, after which nothing more is.
+//
+STFU_INLINE bool
+stfu_private::receiver::receive(int fd) noexcept
+{
+    const std::size_t header = 1 + sizeof(std::uint32_t);
+    char chunk[4096];
+    ssize_t l;
+
+    do {
+        l = ::read(fd, chunk, sizeof(chunk));
+    } while (l < 0 && EINTR == errno);
+
+    if (l < 1 || corrupt) {
+        return false;
+    }
+
+    buffer.append(chunk, l);
+
+    std::size_t pos = 0;
+    while (buffer.size() - pos >= header) {
+        std::uint32_t length;
+        std::memcpy(&length, buffer.data() + pos + 1, sizeof(length));
+
+        if (buffer.size() - pos - header < length) {
+            break;
+        }
+
+        const auto type = static_cast<record>(buffer[pos]);
+        if (!apply(type, buffer.substr(pos + header, length), data)) {
+            corrupt = true;
+            buffer.clear();
+            return false;
+        }
+        done = done || (record::RESULT == type);
+        pos += header + length;
+    }
+
+    buffer.erase(0, pos);
+
+    return true;
+}
+
+//
+// Receive everything immediately available, without blocking.
+//
+STFU_INLINE void
+stfu_private::receiver::drain(int fd) noexcept
+{
+    pollfd p{fd, POLLIN, 0};
+
+    while (::poll(&p, 1, 0) > 0 && receive(fd)) {
+    }
+}
+
+STFU_INLINE bool
+stfu_private::receiver::concluded() const noexcept
+{
+    return done;
+}
+
+STFU_INLINE bool
+stfu_private::receiver::corrupted() const noexcept
+{
+    return corrupt;
+}
+
+STFU_INLINE
+stfu_private::ring::ring(std::size_t n):
+    buffer(n, '\0'), limit{n}
+{
+}
+
+STFU_INLINE void
+stfu_private::ring::append(const char* p, std::size_t len)
+{
+    if (0 == limit) {
+        total += len;
+        return;
+    }
+
+    // Only the last limit bytes of a large write can survive.
+    if (len > limit) {
+        total += len - limit;
+        p += len - limit;
+        len = limit;
+    }
+
+    std::size_t pos = total % limit;
+    const std::size_t first = std::min(len, limit - pos);
+
+    buffer.replace(pos, first, p, first);
+    buffer.replace(0, len - first, p + first, len - first);
+    total += len;
+}
+
+//
+// Read whatever is available. Returns false once the other end has closed
+// (or on error).
+//
+STFU_INLINE bool
+stfu_private::ring::receive(int fd) noexcept
+{
+    char chunk[4096];
+    ssize_t l;
+
+    do {
+        l = ::read(fd, chunk, sizeof(chunk));
+    } while (l < 0 && EINTR == errno);
+
+    if (l < 1) {
+        return false;
+    }
+
+    append(chunk, l);
+    return true;
+}
+
+STFU_INLINE void
+stfu_private::ring::drain(int fd) noexcept
+{
+    pollfd p{fd, POLLIN, 0};
+
+    while (::poll(&p, 1, 0) > 0 && receive(fd)) {
+    }
+}
+
+STFU_INLINE std::string
+stfu_private::ring::str() const
+{
+    if (total <= limit || 0 == limit) {
+        return buffer.substr(0, std::min(total, limit));
+    }
+
+    const std::size_t pos = total % limit;
+    return buffer.substr(pos) + buffer.substr(0, pos);
+}
+
+STFU_INLINE std::size_t
+stfu_private::ring::size() const noexcept
+{
+    return total;
+}
+
+STFU_INLINE
+stfu_private::stdio_redirect::stdio_redirect(int fd) noexcept:
+    saved{-1, -1}
+{
+    if (-1 == fd) {
+        return;
+    }
+
+    flush_stdio();
+
+    saved[0] = ::dup(STDOUT_FILENO);
+    saved[1] = ::dup(STDERR_FILENO);
+    ::dup2(fd, STDOUT_FILENO);
+    ::dup2(fd, STDERR_FILENO);
+}
+
+STFU_INLINE
+stfu_private::stdio_redirect::~stdio_redirect()
+{
+    if (-1 == saved[0]) {
+        return;
+    }
+
+    flush_stdio();
+
+    ::dup2(saved[0], STDOUT_FILENO);
+    ::dup2(saved[1], STDERR_FILENO);
+    ::close(saved[0]);
+    ::close(saved[1]);
+}
+
+//
+// Push out anything buffered for standard output or error, at both the C++
+// and C levels.
+//
+STFU_INLINE void
+stfu_private::flush_stdio() noexcept
+{
+    try {
+        std::cout.flush();
+        std::cerr.flush();
+        std::clog.flush();
+    } catch (...) {
+    }
+
+    std::fflush(nullptr);
+}
+
+//
+// Read the last part of a file (as much as the ring retains), accounting
+// for its full size.
+//
+STFU_INLINE void
+stfu_private::read_tail(int fd, ring& tail) noexcept
+{
+    struct stat st;
+
+    if (0 != ::fstat(fd, &st) || st.st_size <= 0) {
+        return;
+    }
+
+    const std::size_t size = st.st_size;
+    const std::size_t keep = std::min(size, tail.limit);
+    std::string chunk(keep, '\0');
+
+    ssize_t l = ::pread(fd, &chunk[0], keep, size - keep);
+    if (l < 0) {
+        l = 0;
+    }
+
+    tail.total += size - keep;
+    tail.append(chunk.data(), l);
+}
+
+STFU_INLINE const char*
+stfu_private::result_name(stfu::test_result r) noexcept
+{
+    switch (r) {
+    case stfu::test_result::DIDNT_RUN:
+        return "DIDNT_RUN";
+    case stfu::test_result::SKIPPED:
+        return "SKIPPED";
+    case stfu::test_result::PASS:
+        return "PASS";
+    case stfu::test_result::FAIL:
+        return "FAIL";
+    case stfu::test_result::CRASH:
+        return "CRASH";
+    case stfu::test_result::TIMEOUT:
+        return "TIMEOUT";
+    case stfu::test_result::SLOW:
+        return "SLOW";
+    case stfu::test_result::OUT_OF_RESOURCES:
+        return "OUT_OF_RESOURCES";
+    }
+
+    return "UNKNOWN";
+}
+
+//
+// A JSON string literal (also valid YAML) of the given text.
+//
+STFU_INLINE std::string
+stfu_private::json_quote(const std::string& text)
+{
+    std::string quoted{"\""};
+
+    for (const unsigned char c: text) {
+        switch (c) {
+        case '"':
+            quoted.append("\\\"");
+            break;
+        case '\\':
+            quoted.append("\\\\");
+            break;
+        case '\n':
+            quoted.append("\\n");
+            break;
+        case '\t':
+            quoted.append("\\t");
+            break;
+        default:
+            if (c < 0x20 || 0x7f == c) {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                quoted.append(escape);
+            } else {
+                quoted.push_back(c);
+            }
+        }
+    }
+
+    return quoted.append("\"");
+}
+
+//
+// An XML attribute value (in quotes) of the given text. Control characters,
+// which XML 1.0 can't represent at all, are dropped.
+//
+STFU_INLINE std::string
+stfu_private::xml_quote(const std::string& text)
+{
+    std::string quoted{"\""};
+
+    for (const unsigned char c: text) {
+        switch (c) {
+        case '"':
+            quoted.append("&quot;");
+            break;
+        case '&':
+            quoted.append("&amp;");
+            break;
+        case '<':
+            quoted.append("&lt;");
+            break;
+        case '>':
+            quoted.append("&gt;");
+            break;
+        case '\n':
+            quoted.append("&#10;");
+            break;
+        case '\t':
+            quoted.append("&#9;");
+            break;
+        default:
+            if (c >= 0x20) {
+                quoted.push_back(c);
+            }
+        }
+    }
+
+    return quoted.append("\"");
+}
+
+STFU_INLINE stfu_private::measure
+stfu_private::measure_of(const stfu::test_result_data& r)
+{
+    for (const auto &m: r.metrics) {
+        if ("ns/op" == m.first) {
+            return measure{m.second, m.first};
+        }
+    }
+
+    return measure{r.phases.body.count(), "s"};
+}
+
+//
+// Read the measures of a group's tests from a baseline file. A missing or
+// unreadable file is an empty baseline.
+//
+STFU_INLINE stfu_private::baseline
+stfu_private::load_baseline(const std::string& path,
+                            const std::string& group)
+{
+    baseline b;
+    std::ifstream in{path};
+    std::string line;
+
+    while (std::getline(in, line)) {
+        std::istringstream fields{line};
+        std::string g, t, value, unit;
+
+        if (std::getline(fields, g, '\t') && group == g &&
+            std::getline(fields, t, '\t') &&
+            std::getline(fields, value, '\t') &&
+            std::getline(fields, unit)) {
+            b[t] = measure{std::strtod(value.c_str(), nullptr), unit};
+        }
+    }
+
+    return b;
+}
+
+//
+// Replace a group's measures in a baseline file, keeping those of other
+// groups.
+//
+STFU_INLINE bool
+stfu_private::save_baseline(const std::string& path,
+                            const std::string& group, const baseline& b)
+{
+    std::ostringstream lines;
+
+    lines << std::setprecision(17);
+    for (const auto &e: b) {
+        lines << group << '\t' << e.first << '\t' << e.second.value << '\t'
+              << e.second.unit << '\n';
+    }
+
+    return save_group(path, group, lines.str());
+}
+
+STFU_INLINE bool
+stfu_private::cached::passed() const
+{
+    return "PASS" == result;
+}
+
+STFU_INLINE bool
+stfu_private::cached::failed() const
+{
+    return !passed() && "SKIPPED" != result && "DIDNT_RUN" != result;
+}
+
+//
+// Key of the running executable: a hash of its content, in hex. The same
+// build gets the same key wherever it runs from.
+//
+STFU_INLINE const std::string&
+stfu_private::binary_key()
+{
+    static const std::string key = [] {
+        std::ifstream in{"/proc/self/exe", std::ios::binary};
+        std::uint64_t h = 14695981039346656037ull;
+        char buffer[65536];
+
+        while (in.read(buffer, sizeof buffer) || 0 < in.gcount()) {
+            for (std::streamsize i = 0; i < in.gcount(); ++i) {
+                h = (h ^ static_cast<unsigned char>(buffer[i])) *
+                    1099511628211ull;
+            }
+        }
+
+        std::ostringstream hex;
+        hex << std::hex << std::setw(16) << std::setfill('0') << h;
+        return hex.str();
+    }();
+
+    return key;
+}
+
+STFU_INLINE stfu_private::history
+stfu_private::load_history(const std::string& path,
+                           const std::string& group)
+{
+    history h;
+    std::ifstream in{path};
+    std::string line;
+
+    while (std::getline(in, line)) {
+        std::istringstream fields{line};
+        std::string g, t, key, result, runtime;
+
+        if (std::getline(fields, g, '\t') && group == g &&
+            std::getline(fields, t, '\t') &&
+            std::getline(fields, key, '\t') &&
+            std::getline(fields, result, '\t') &&
+            std::getline(fields, runtime)) {
+            h[t] = cached{key, result, std::strtod(runtime.c_str(), nullptr)};
+        }
+    }
+
+    return h;
+}
+
+STFU_INLINE bool
+stfu_private::save_history(const std::string& path,
+                           const std::string& group, const history& h)
+{
+    std::ostringstream lines;
+
+    lines << std::setprecision(17);
+    for (const auto &e: h) {
+        lines << group << '\t' << e.first << '\t' << e.second.key << '\t'
+              << e.second.result << '\t' << e.second.runtime << '\n';
+    }
+
+    return save_group(path, group, lines.str());
+}
+
+STFU_INLINE bool
+stfu_private::save_group(const std::string& path, const std::string& group,
+                         const std::string& lines)
+{
+    // The groups of a suite may be saving to the same file at once, so
+    // lock it, making sure it's still the file at the path once locked (and
+    // not one since replaced).
+    int lock;
+    for (;;) {
+        lock = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (-1 == lock || 0 != ::flock(lock, LOCK_EX)) {
+            break;
+        }
+
+        struct stat locked, current;
+        if (0 == ::fstat(lock, &locked) &&
+            0 == ::stat(path.c_str(), &current) &&
+            locked.st_dev == current.st_dev &&
+            locked.st_ino == current.st_ino) {
+            break;
+        }
+        ::close(lock);
+    }
+
+    struct unlock {
+        int fd;
+        ~unlock() {
+            if (-1 != fd) {
+                ::close(fd);
+            }
+        }
+    } unlocked{lock};
+
+    const std::string tmp = path + ".tmp." + std::to_string(::getpid());
+    std::ifstream in{path};
+    std::ofstream out{tmp, std::ios::trunc};
+    std::string line;
+
+    while (std::getline(in, line)) {
+        if (0 != line.compare(0, group.size() + 1, group + "\t")) {
+            out << line << '\n';
+        }
+    }
+
+    out << lines;
+    out.close();
+
+    if (!out || 0 != std::rename(tmp.c_str(), path.c_str())) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+STFU_INLINE std::string
+stfu_private::demangle(const char* mangled)
+{
+    std::string name = mangled;
+
+#if defined(__GNUG__)
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(mangled, nullptr, nullptr,
+                                          &status);
+    if (0 == status && nullptr != demangled) {
+        name = demangled;
+    }
+    std::free(demangled);
+#endif
+
+    return name;
+}
+
+//
+// Put the given number of tokens in a new pipe. Taking one never blocks.
+//
+STFU_INLINE
+stfu_private::jobserver::jobserver(std::size_t n)
+{
+    if (0 != ::pipe(filedes)) {
+        filedes[0] = filedes[1] = -1;
+        return;
+    }
+
+    ::fcntl(filedes[0], F_SETFL, ::fcntl(filedes[0], F_GETFL) | O_NONBLOCK);
+
+    for (std::size_t i = 0; i < n; ++i) {
+        release();
+    }
+}
+
+STFU_INLINE
+stfu_private::jobserver::~jobserver()
+{
+    for (int i: filedes) {
+        if (-1 != i) {
+            ::close(i);
+        }
+    }
+}
+
+STFU_INLINE bool
+stfu_private::jobserver::valid() const noexcept
+{
+    return -1 != filedes[0];
+}
+
+STFU_INLINE bool
+stfu_private::jobserver::acquire() const noexcept
+{
+    char token;
+    ssize_t n;
+
+    while ((n = ::read(filedes[0], &token, 1)) < 0 && EINTR == errno) {
+    }
+
+    return 1 == n;
+}
+
+STFU_INLINE void
+stfu_private::jobserver::release() const noexcept
+{
+    const char token = '+';
+
+    while (::write(filedes[1], &token, 1) < 0 && EINTR == errno) {
+    }
+}
+
+STFU_INLINE int
+stfu_private::jobserver::fd() const noexcept
+{
+    return filedes[0];
+}
+
+STFU_INLINE std::atomic<std::size_t>*
+stfu_private::allocation_counters() noexcept
+{
+    // Constant-initialized, so usable by allocations before main().
+    static std::atomic<std::size_t> counters[3];
+    return counters;
+}
+
+STFU_INLINE std::atomic<bool>&
+stfu_private::counting_allocations() noexcept
+{
+    static std::atomic<bool> counting{false};
+    return counting;
+}
+
+STFU_INLINE stfu::allocation_counts
+stfu_private::allocations_now() noexcept
+{
+    const auto c = allocation_counters();
+    stfu::allocation_counts a;
+
+    a.allocations = c[0].load(std::memory_order_relaxed);
+    a.deallocations = c[1].load(std::memory_order_relaxed);
+    a.bytes = c[2].load(std::memory_order_relaxed);
+    return a;
+}
+
+STFU_INLINE stfu::allocation_counts
+stfu_private::allocations_since(const stfu::allocation_counts& before,
+                                const stfu::allocation_counts& after) noexcept
+{
+    stfu::allocation_counts a;
+
+    a.allocations = after.allocations - before.allocations;
+    a.deallocations = after.deallocations - before.deallocations;
+    a.bytes = after.bytes - before.bytes;
+    return a;
+}
+
+STFU_INLINE void*
+stfu_private::allocate(std::size_t size) noexcept
+{
+    const auto c = allocation_counters();
+
+    c[0].fetch_add(1, std::memory_order_relaxed);
+    c[2].fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(0 != size ? size : 1);
+}
+
+STFU_INLINE void
+stfu_private::deallocate(void* p) noexcept
+{
+    if (nullptr != p) {
+        allocation_counters()[1].fetch_add(1, std::memory_order_relaxed);
+        std::free(p);
+    }
+}
+
+STFU_INLINE std::vector<std::string>
+stfu_private::place(const stfu::placement& p)
+{
+    std::vector<std::string> notes;
+
+    auto failed = [&](const std::string& what) {
+        notes.push_back("couldn't " + what + ": " + std::strerror(errno));
+    };
+
+#if defined(__linux__)
+    if (!p.cpus.empty()) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        for (int cpu: p.cpus) {
+            if (0 <= cpu && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (0 != ::sched_setaffinity(0, sizeof(set), &set)) {
+            failed("pin to CPUs");
+        }
+    }
+
+    // Without libnuma, bind memory to the node with the system call itself.
+    if (0 <= p.numa_node) {
+        const std::size_t bits = CHAR_BIT * sizeof(unsigned long);
+        std::vector<unsigned long> mask(p.numa_node / bits + 1, 0);
+
+        mask[p.numa_node / bits] |= 1UL << (p.numa_node % bits);
+        if (0 != ::syscall(SYS_set_mempolicy, MPOL_BIND, mask.data(),
+                           mask.size() * bits + 1)) {
+            failed("bind memory to NUMA node " +
+                   std::to_string(p.numa_node));
+        }
+    }
+#else
+    if (!p.cpus.empty() || 0 <= p.numa_node) {
+        errno = ENOTSUP;
+        failed(p.cpus.empty() ? "bind memory to NUMA node" : "pin to CPUs");
+    }
+#endif
+
+    if (0 != p.nice && 0 != ::setpriority(PRIO_PROCESS, 0, p.nice)) {
+        failed("set niceness " + std::to_string(p.nice));
+    }
+
+    if (0 != p.fifo_priority) {
+        sched_param param;
+
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = p.fifo_priority;
+        if (0 != ::sched_setscheduler(0, SCHED_FIFO, &param)) {
+            failed("set SCHED_FIFO priority " +
+                   std::to_string(p.fifo_priority));
+        }
+    }
+
+    return notes;
+}
+
+STFU_INLINE std::vector<std::string>
+stfu_private::limit(const stfu::resource_limits& l, const std::string& cgroup)
+{
+    std::vector<std::string> notes;
+
+    auto failed = [&](const std::string& what) {
+        notes.push_back("couldn't " + what + ": " + std::strerror(errno));
+    };
+
+    auto bound = [&](int resource, rlim_t soft, rlim_t hard,
+                     const char* what) {
+        rlimit rl;
+
+        rl.rlim_cur = soft;
+        rl.rlim_max = hard;
+        if (0 != ::setrlimit(resource, &rl)) {
+            failed(std::string{"limit "} + what);
+        }
+    };
+
+    if (0 != l.address_space) {
+        bound(RLIMIT_AS, l.address_space, l.address_space, "address space");
+    }
+
+    // The hard limit is a second later, so SIGXCPU arrives before SIGKILL.
+    if (0 < l.cpu_time.count()) {
+        const rlim_t secs = static_cast<rlim_t>(l.cpu_time.count());
+        bound(RLIMIT_CPU, secs, secs + 1, "CPU time");
+    }
+
+    if (0 != l.open_files) {
+        bound(RLIMIT_NOFILE, l.open_files, l.open_files, "open files");
+    }
+
+    if (cgroup.empty()) {
+        if (0 != l.memory) {
+            errno = ENOTSUP;
+            failed("limit memory without a cgroup");
+        }
+        return notes;
+    }
+
+    // Make a cgroup for this process alone, limit it and then join it.
+    const std::string path = cgroup_of(cgroup, ::getpid());
+
+    auto write = [&](const char* file, const std::string& value) {
+        std::ofstream f{path + "/" + file};
+        f << value;
+        f.flush();
+        return static_cast<bool>(f);
     };
+
+    if (0 != ::mkdir(path.c_str(), 0755)) {
+        failed("make cgroup " + path);
+        return notes;
+    }
+
+    if (0 != l.memory) {
+        if (!write("memory.max", std::to_string(l.memory))) {
+            failed("limit memory in cgroup " + path);
+        }
+        write("memory.swap.max", "0");
+    }
+
+    if (!write("cgroup.procs", "0")) {
+        failed("join cgroup " + path);
+    }
+
+    return notes;
+}
+
+STFU_INLINE std::string
+stfu_private::cgroup_of(const std::string& parent, pid_t pid)
+{
+    return parent + "/stfu." + std::to_string(pid);
+}
+
+STFU_INLINE bool
+stfu_private::release_cgroup(const std::string& path) noexcept
+{
+    bool oom = false;
+
+    try {
+        std::ifstream events{path + "/memory.events"};
+        std::string key;
+        unsigned long long count;
+
+        while (events >> key >> count) {
+            if ("oom_kill" == key && 0 != count) {
+                oom = true;
+            }
+        }
+    } catch (...) {
+    }
+
+    ::rmdir(path.c_str());
+
+    return oom;
+}
+
+STFU_INLINE std::vector<int>
+stfu_private::allowed_cpus()
+{
+    std::vector<int> cpus;
+
+#if defined(__linux__)
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    if (0 == ::sched_getaffinity(0, sizeof(set), &set)) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+
+    return cpus;
+}
+
+STFU_INLINE bool
+stfu_private::advise_pages(const void* p, std::size_t n, int advice) noexcept
+{
+    const std::uintptr_t page = ::sysconf(_SC_PAGESIZE);
+    const std::uintptr_t begin = (reinterpret_cast<std::uintptr_t>(p) +
+                                  page - 1) / page * page;
+    const std::uintptr_t end = (reinterpret_cast<std::uintptr_t>(p) + n) /
+                               page * page;
+
+    return begin < end &&
+           0 == ::madvise(reinterpret_cast<void*>(begin), end - begin,
+                          advice);
 }
 
 //
-// Pretty-print the output of a test result.
+// The zygote is never destroyed, since children exiting would otherwise
+// stop it.
 //
+STFU_INLINE stfu_private::zygote&
+stfu_private::zygote::instance() noexcept
+{
+    static zygote* const z = new zygote;
+    return *z;
+}
 
-inline std::ostream&
-operator<<(std::ostream& out, const stfu::test_result_data& d)
+STFU_INLINE bool
+stfu_private::zygote::start()
 {
-    switch (d.result) {
-    case stfu::test_result::DIDNT_RUN:
-        out << "\aDIDNT_RUN";
-        break;
+    if (-1 != pid) {
+        return true;
+    }
 
-    case stfu::test_result::SKIPPED:
-        out << "SKIPPED";
-        break;
+#if defined(__linux__)
+    int sv[2];
 
-    case stfu::test_result::PASS:
-        out << "PASS";
-        break;
+    // Requests keep their bounds, each with the descriptors it passes.
+    if (0 != ::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv)) {
+        return false;
+    }
 
-    case stfu::test_result::FAIL:
-        out << "\aFAIL";
-        break;
+    // The zygote mustn't inherit (and so repeat) buffered output.
+    flush_stdio();
 
-    case stfu::test_result::CRASH:
-        out << "\aCRASH";
-        break;
+    switch (const pid_t child = ::fork()) {
+    case -1:
+        ::close(sv[0]);
+        ::close(sv[1]);
+        return false;
+
+    case 0:
+        ::close(sv[0]);
+        channel = sv[1];
+        serve();
+
+    default:
+        ::close(sv[1]);
+        channel = sv[0];
+        owner = ::getpid();
+        pid = child;
     }
 
-    if (!d.message.empty()) {
-        out << " (" << d.message << ")";
+    return true;
+#else
+    return false;
+#endif
+}
+
+STFU_INLINE void
+stfu_private::zygote::stop() noexcept
+{
+    if (-1 == pid || owner != ::getpid()) {
+        return;
     }
 
-    return out;
+    // The zygote exits once its channel is closed.
+    ::close(channel);
+    while (-1 == ::waitpid(pid, nullptr, 0) && EINTR == errno) {
+    }
+
+    pid = owner = -1;
+    channel = -1;
 }
 
 //
-// test class implementation
+// Only the process which started the zygote may use it, since the children
+// of a suite's groups would otherwise share (and mix up) its channel.
 //
+STFU_INLINE bool
+stfu_private::zygote::available() const noexcept
+{
+    return -1 != pid && owner == ::getpid();
+}
 
-inline
-stfu::test::test(const char* n, test_routine f, const char* d) noexcept:
-    fn{std::move(f)}, name{n}, description{d}
+//
+// Request a child to run the routine, passing it the result channel, the
+// pipe to relay its exit over and its output descriptor. Returns the child's
+// pid, or -1 if there's no zygote to ask (or it failed).
+//
+STFU_INLINE pid_t
+stfu_private::zygote::spawn(void (*routine)(),
+                            const stfu::test::run_settings& settings,
+                            int results, int relay, int output)
 {
+    if (!available()) {
+        return -1;
+    }
+
+    std::string request(reinterpret_cast<const char*>(&routine),
+                        sizeof(routine));
+    request.append(encode(settings));
+
+    const int fds[3] = { results, relay, output };
+    const std::size_t count = (-1 == output) ? 2 : 3;
+    char control[CMSG_SPACE(sizeof(fds))];
+    iovec iov{const_cast<char*>(request.data()), request.size()};
+    msghdr msg;
+
+    std::memset(&msg, 0, sizeof(msg));
+    std::memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(count * sizeof(int));
+
+    cmsghdr* const cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+
+    pid_t child = -1;
+
+    if (static_cast<ssize_t>(request.size()) !=
+        ::sendmsg(channel, &msg, MSG_NOSIGNAL) ||
+        !read_all(channel, &child, sizeof(child))) {
+        // The zygote is gone; fork from here from now on.
+        stop();
+        return -1;
+    }
+
+    return child;
 }
 
-inline
-stfu::test::~test()
+//
+// Body of the zygote: fork a child for each request and reply with its pid,
+// and relay the exit of each child as it's reaped. Exits once the channel is
+// closed.
+//
+STFU_INLINE void
+stfu_private::zygote::serve()
 {
-    for (int i: filedes) {
-        if (-1 != i) {
-            ::close(i);
+    // Children's exits are taken from a signalfd, alongside requests.
+    sigset_t exits, saved;
+    ::sigemptyset(&exits);
+    ::sigaddset(&exits, SIGCHLD);
+    ::sigprocmask(SIG_BLOCK, &exits, &saved);
+
+    const int exited = ::signalfd(-1, &exits, 0);
+    if (-1 == exited) {
+        ::_exit(1);
+    }
+
+    std::map<pid_t, int> relays;
+    std::vector<char> buffer(65536);
+
+    for (;;) {
+        pollfd p[2] = { { channel, POLLIN, 0 }, { exited, POLLIN, 0 } };
+
+        if (::poll(p, 2, -1) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            ::_exit(1);
+        }
+
+        if (0 != p[1].revents) {
+            signalfd_siginfo info;
+            if (::read(exited, &info, sizeof(info)) < 0) {
+                // Any exits are reaped below, whatever was read.
+            }
+
+            int stat_loc;
+            rusage ru;
+            pid_t child;
+
+            while (0 < (child = ::wait4(-1, &stat_loc, WNOHANG, &ru))) {
+                const auto r = relays.find(child);
+                if (relays.end() != r) {
+                    write_all(r->second, &stat_loc, sizeof(stat_loc));
+                    write_all(r->second, &ru, sizeof(ru));
+                    ::close(r->second);
+                    relays.erase(r);
+                }
+            }
+        }
+
+        if (0 == p[0].revents) {
+            continue;
+        }
+
+        int fds[3] = { -1, -1, -1 };
+        char control[CMSG_SPACE(sizeof(fds))];
+        iovec iov{buffer.data(), buffer.size()};
+        msghdr msg;
+
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        const ssize_t n = ::recvmsg(channel, &msg, 0);
+        if (n < 0 && EINTR == errno) {
+            continue;
+        }
+        if (n < static_cast<ssize_t>(sizeof(void (*)()))) {
+            ::_exit(0);
+        }
+
+        // Take as many descriptors as a request passes; close any others.
+        const std::size_t wanted = sizeof(fds) / sizeof(fds[0]);
+        std::size_t received = 0;
+
+        for (cmsghdr* c = CMSG_FIRSTHDR(&msg); nullptr != c;
+             c = CMSG_NXTHDR(&msg, c)) {
+            if (SOL_SOCKET != c->cmsg_level || SCM_RIGHTS != c->cmsg_type ||
+                c->cmsg_len < CMSG_LEN(0)) {
+                continue;
+            }
+
+            const std::size_t count = (c->cmsg_len - CMSG_LEN(0)) /
+                                      sizeof(int);
+            for (std::size_t i = 0; i < count; ++i) {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(fd));
+                if (received < wanted) {
+                    fds[received++] = fd;
+                } else {
+                    ::close(fd);
+                }
+            }
+        }
+
+        void (*routine)();
+        std::memcpy(&routine, buffer.data(), sizeof(routine));
+        const auto settings = decode(std::string(
+                buffer.data() + sizeof(routine), n - sizeof(routine)));
+
+        pid_t child = -1;
+
+        if (-1 != fds[0] && -1 != fds[1]) {
+            child = ::fork();
+        }
+
+        // The child keeps only its own descriptors, and the program's mask.
+        if (0 == child) {
+            ::close(channel);
+            ::close(exited);
+            ::close(fds[1]);
+            for (const auto &r: relays) {
+                ::close(r.second);
+            }
+            ::sigprocmask(SIG_SETMASK, &saved, nullptr);
+            stfu::test{"zygote", routine}.run_child(fds[0], fds[2], settings);
+        }
+
+        if (0 < child) {
+            relays[child] = fds[1];
+            fds[1] = -1;
+        }
+
+        for (int fd: fds) {
+            if (-1 != fd) {
+                ::close(fd);
+            }
         }
+
+        write_all(channel, &child, sizeof(child));
     }
 }
 
-inline const std::string&
-stfu::test::get_name() const noexcept
+STFU_INLINE std::string
+stfu_private::zygote::encode(const stfu::test::run_settings& s)
 {
-    return name;
+    std::ostringstream out;
+
+    out << s.counters << ' ' << s.place.nice << ' ' << s.place.fifo_priority
+        << ' ' << s.place.numa_node << ' ' << s.place.cpus.size();
+    for (int cpu: s.place.cpus) {
+        out << ' ' << cpu;
+    }
+    out << ' ' << s.limits.address_space << ' ' << s.limits.memory << ' '
+        << s.limits.cpu_time.count() << ' ' << s.limits.open_files << '\n'
+        << s.cgroup;
+
+    return out.str();
 }
 
-inline const std::string&
-stfu::test::get_description() const noexcept
+STFU_INLINE stfu::test::run_settings
+stfu_private::zygote::decode(const std::string& text)
 {
-    return description;
+    std::istringstream in{text};
+    stfu::test::run_settings s;
+    std::size_t cpus = 0;
+    long long cpu_time = 0;
+
+    in >> s.counters >> s.place.nice >> s.place.fifo_priority
+       >> s.place.numa_node >> cpus;
+    for (std::size_t i = 0; i < cpus; ++i) {
+        int cpu;
+        if (in >> cpu) {
+            s.place.cpus.push_back(cpu);
+        }
+    }
+    in >> s.limits.address_space >> s.limits.memory >> cpu_time
+       >> s.limits.open_files;
+    s.limits.cpu_time = std::chrono::seconds{cpu_time};
+
+    in.ignore(1);
+    std::getline(in, s.cgroup);
+
+    return s;
 }
 
-inline bool
-stfu::test::is_enabled() const noexcept
+STFU_INLINE
+stfu_private::perf_events::perf_events(bool enable) noexcept
 {
-    return enabled;
+    for (auto &fd: fds) {
+        fd = -1;
+    }
+
+#if defined(__linux__) && defined(SYS_perf_event_open)
+    static const struct {
+        std::uint32_t type;
+        std::uint64_t config;
+    } events[count] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    };
+
+    if (!enable) {
+        return;
+    }
+
+    // Each event is counted on its own, so that any of them may be missing;
+    // only user space is counted, as unprivileged processes may.
+    for (std::size_t i = 0; i < count; ++i) {
+        perf_event_attr attr;
+
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        fds[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0,
+                                            -1, -1, 0));
+        if (-1 != fds[i]) {
+            ::fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        }
+    }
+#else
+    (void) enable;
+#endif
 }
 
-inline stfu::test&
-stfu::test::set_enable(bool b) noexcept
+STFU_INLINE
+stfu_private::perf_events::~perf_events()
 {
-    enabled = b;
-    return *this;
+    for (int fd: fds) {
+        if (-1 != fd) {
+            ::close(fd);
+        }
+    }
 }
 
-inline void
-stfu::test::write_result(test_result r) const noexcept
+STFU_INLINE void
+stfu_private::perf_events::start() noexcept
 {
-    write_result(r, "");
+#if defined(__linux__) && defined(SYS_perf_event_open)
+    for (int fd: fds) {
+        if (-1 != fd) {
+            ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
 }
 
-inline void
-stfu::test::write_result(test_result r, const std::string& m) const noexcept
+//
+// Stop counting, and store the counts. Those multiplexed with other events
+// are scaled up to the whole time they were enabled.
+//
+STFU_INLINE void
+stfu_private::perf_events::stop(stfu::perf_counters& c) noexcept
+{
+    long long* const values[count] = {
+        &c.cycles, &c.instructions, &c.cache_references, &c.cache_misses,
+        &c.branch_misses, &c.task_clock
+    };
+
+#if defined(__linux__) && defined(SYS_perf_event_open)
+    for (int fd: fds) {
+        if (-1 != fd) {
+            ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+
+    for (std::size_t i = 0; i < count; ++i) {
+        std::uint64_t read_format[3];   // Value, time enabled, time running
+
+        *values[i] = -1;
+        if (-1 != fds[i] &&
+            sizeof(read_format) ==
+            ::read(fds[i], read_format, sizeof(read_format)) &&
+            0 != read_format[2]) {
+            *values[i] = static_cast<long long>(
+                    static_cast<double>(read_format[0]) *
+                    read_format[1] / read_format[2]);
+        }
+    }
+}
+
+STFU_INLINE
+stfu_private::no_alloc_scope::no_alloc_scope(const char* f,
+                                             std::size_t l) noexcept:
+    file{f}, line{l}
+{
+}
+
+//
+// True on entering the scope; on leaving it, fails if anything allocated.
+//
+STFU_INLINE bool
+stfu_private::no_alloc_scope::enter()
 {
-    switch (r) {
-    case test_result::PASS:
-        ::write(filedes[write_end], "PASS", 4);
-        break;
+    if (!counting_allocations()) {
+        throw failed_assert{file, line, "allocation counting enabled"};
+    }
 
-    default:
-        ::write(filedes[write_end], "FAIL", 4);
+    const std::size_t now =
+            allocation_counters()[0].load(std::memory_order_relaxed);
+
+    if (!entered) {
+        entered = true;
+        before = now;
+        return true;
     }
 
-    if (!m.empty()) {
-        ::write(filedes[write_end], m.c_str(), m.length());
+    if (now != before) {
+        throw failed_assert{file, line, "no allocation"};
     }
 
-    close_handle(write_end);
+    return false;
 }
 
-inline stfu::test_result_data
-stfu::test::read_result() const noexcept
+STFU_INLINE bool
+stfu_private::getenv(const char* var, unsigned long& value) noexcept
 {
-    test_result_data r;
-    char buffer[128];
-    ssize_t l;
-    std::string message;
+    const char* env = std::getenv(var);
+    char* end;
 
-    l = ::read(filedes[read_end], buffer, sizeof(buffer));
+    if (nullptr == env) {
+        return false;
+    }
 
-    if (l < 1) {
-        message = "Test system failure";
-    } else {
-        message.assign(buffer, l);
+    unsigned long v = std::strtoul(env, &end, 10);
+    if (end == env || '\0' != *end) {
+        return false;
     }
 
-    if (0 == message.compare(0, 4, "PASS")) {
-        r.result = test_result::PASS;
-    } else {
-        r.result = test_result::FAIL;
+    value = v;
+    return true;
+}
+
+STFU_INLINE bool
+stfu_private::getenv(const char* var, double& value) noexcept
+{
+    const char* env = std::getenv(var);
+    char* end;
+
+    if (nullptr == env) {
+        return false;
     }
 
-    if (4 < l) {
-        r.message = message.substr(4);
+    double v = std::strtod(env, &end);
+    if (end == env || '\0' != *end) {
+        return false;
     }
 
-    return r;
+    value = v;
+    return true;
 }
 
-inline void
-stfu::test::close_handle(pipe_end e) const noexcept
+STFU_INLINE int
+stfu_private::poll_timeout(std::chrono::steady_clock::time_point t) noexcept
 {
-    ::close(filedes[e]);
-    filedes[e] = -1;
+    using namespace std::chrono;
+
+    if (steady_clock::time_point::max() == t) {
+        return -1;
+    }
+
+    const auto now = steady_clock::now();
+    if (t <= now) {
+        return 0;
+    }
+
+    // Round up, so as not to wake just shy of the deadline.
+    const auto ms = duration_cast<milliseconds>(t - now) + milliseconds{1};
+    return static_cast<int>(std::min<milliseconds::rep>(ms.count(), INT_MAX));
 }
 
-inline stfu::test_result_data
-stfu::test::operator()() const
+//
+// Without a deadline, simply block until the child terminates. Otherwise
+// poll for it, backing off up to 10ms between attempts.
+//
+STFU_INLINE pid_t
+stfu_private::wait(pid_t pid, int& stat_loc,
+                   std::chrono::steady_clock::time_point limit,
+                   bool& killed, rusage* usage) noexcept
 {
     using namespace std::chrono;
 
-    stfu::test_result_data r;
+    long backoff = 50000;
+    pid_t rc;
 
-    if (!enabled) {
-        r.result = stfu::test_result::SKIPPED;
-        return r;
-    }
+    killed = false;
 
-    if (0 != ::pipe(filedes)) {
-        return r;
-    }
+    for (;;) {
+        const bool block = killed || steady_clock::time_point::max() == limit;
 
-    auto t1 = high_resolution_clock::now();
+        rc = ::wait4(pid, &stat_loc, block ? 0 : WNOHANG, usage);
 
-    switch (pid_t pid = ::fork()) {
-    // Error case
-    case -1:
-        break;
+        if (-1 == rc && EINTR == errno) {
+            continue;
+        }
 
-    // Child
-    case 0:
-        close_handle(read_end);
+        if (0 != rc) {
+            return rc;
+        }
 
-        try {
-            fn();
-        } catch (const stfu_private::pass&) {
-            write_result(test_result::PASS);
-            ::exit(0);
-        } catch (const stfu_private::fail& e) {
-            write_result(test_result::FAIL, e.get_message());
-            ::exit(0);
+        if (steady_clock::now() >= limit) {
+            ::kill(pid, SIGKILL);
+            killed = true;
+            continue;
         }
-        ::exit(-1);
 
-    // Parent
-    default:
-        close_handle(write_end);
+        const timespec ts{0, backoff};
+        ::nanosleep(&ts, nullptr);
+        backoff = std::min(backoff * 2, 10000000L);
+    }
+}
 
-        int stat_loc;
+STFU_INLINE pid_t
+stfu_private::wait_relayed(int fd, pid_t pid, int& stat_loc,
+                           std::chrono::steady_clock::time_point limit,
+                           bool& killed, rusage* usage) noexcept
+{
+    rusage ru;
 
-        // Test ran; default result is FAIL.
-        r.result = stfu::test_result::FAIL;
+    killed = false;
 
-        // Unable to reap the child.
-        if (::waitpid(pid, &stat_loc, 0) != pid) {
-            break;
+    for (;;) {
+        pollfd p{fd, POLLIN, 0};
+        const int rc = ::poll(&p, 1, killed ? -1 : poll_timeout(limit));
+
+        if (rc < 0 && EINTR == errno) {
+            continue;
         }
 
-        // Iff the child exited with 0, read the test result.
-        if (WIFEXITED(stat_loc) && (0 == WEXITSTATUS(stat_loc))) {
-            r = read_result();
-            break;
+        if (0 == rc) {
+            ::kill(pid, SIGKILL);
+            killed = true;
+            continue;
         }
 
-        // Any signal-termination condition is considered a CRASH.
-        if (WIFSIGNALED(stat_loc)) {
-            r.result = stfu::test_result::CRASH;
+        // Without a status (if the zygote is gone), the child is lost.
+        if (rc < 0 || !read_all(fd, &stat_loc, sizeof(stat_loc)) ||
+            !read_all(fd, &ru, sizeof(ru))) {
+            return -1;
+        }
 
-            const int signal = WTERMSIG(stat_loc);
-            if (signal < NSIG) {
-                r.message.append("crashed with: ")
-                         .append(::sys_siglist[signal]);
-            }
-            break;
+        if (nullptr != usage) {
+            *usage = ru;
         }
+
+        return pid;
     }
+}
 
-    auto t2 = high_resolution_clock::now();
+STFU_INLINE stfu::resource_usage
+stfu_private::usage_of(const rusage& ru) noexcept
+{
+    using namespace std::chrono;
 
-    r.runtime = duration_cast<duration<double>>(t2 - t1);
+    auto seconds = [](const timeval& tv) {
+        return duration<double>{tv.tv_sec + tv.tv_usec / 1e6};
+    };
 
-    return r;
-}
+    stfu::resource_usage u;
 
-//
-// test_group implementation
-//
+    u.user = seconds(ru.ru_utime);
+    u.system = seconds(ru.ru_stime);
+    u.max_rss = ru.ru_maxrss;
+    u.minor_faults = ru.ru_minflt;
+    u.major_faults = ru.ru_majflt;
+    u.voluntary_switches = ru.ru_nvcsw;
+    u.involuntary_switches = ru.ru_nivcsw;
 
-inline
-stfu::test_group::test_group(const char* n, const char* d) noexcept:
-    name{n}, description{d}
-{
+    return u;
 }
 
-inline stfu::test_group&
-stfu::test_group::set_verbose(bool b) noexcept
+STFU_INLINE stfu::resource_usage
+stfu_private::usage_self() noexcept
 {
-    verbose = b;
-    return *this;
-}
+    rusage ru;
 
-inline stfu::test_group&
-stfu::test_group::add_test(const stfu::test& test)
-{
-    tests.push_back(test);
-    return *this;
-}
+    if (0 != ::getrusage(RUSAGE_SELF, &ru)) {
+        return stfu::resource_usage{};
+    }
 
-inline stfu::test_group&
-stfu::test_group::add_before_all(const fixture& f)
-{
-    before_all.push_back(f);
-    return *this;
+    return usage_of(ru);
 }
 
-inline stfu::test_group&
-stfu::test_group::add_before_each(const fixture& f)
+STFU_INLINE stfu::resource_usage
+stfu_private::usage_since(const stfu::resource_usage& before,
+                          const stfu::resource_usage& after) noexcept
 {
-    before_each.push_back(f);
-    return *this;
-}
+    stfu::resource_usage u = after;
 
-inline stfu::test_group&
-stfu::test_group::add_after_all(const fixture& f)
-{
-    after_all.push_back(f);
-    return *this;
-}
+    u.user -= before.user;
+    u.system -= before.system;
+    u.minor_faults -= before.minor_faults;
+    u.major_faults -= before.major_faults;
+    u.voluntary_switches -= before.voluntary_switches;
+    u.involuntary_switches -= before.involuntary_switches;
 
-inline stfu::test_group&
-stfu::test_group::add_after_each(const fixture& f)
-{
-    after_each.push_back(f);
-    return *this;
+    return u;
 }
 
-inline stfu::test_result_summary
-stfu::test_group::operator()(std::ostream& out) const
+STFU_INLINE void
+stfu_private::describe_signal(int stat_loc, stfu::test_result_data& r)
 {
-    using stfu_private::fixture_exception;
-
-    stfu_private::widthstream wrapped_comment{75, out};
-    test_result_summary results;
-
-    // Initialize based on all the tests yet to run.
-    results.didnt_run = tests.size();
-
-    if (verbose) {
-        out << "#" << std::endl
-            << "# STFU version " STFU_VERSION << std::endl
-            << "#" << std::endl
-            << "# Running " << tests.size() << " test(s) "
-            << "in group: " << name << std::endl;
-
-        out << "#" << std::endl
-            << "# " << description << std::endl
-            << "#" << std::endl;
+    if (!WIFSIGNALED(stat_loc)) {
+        return;
     }
 
-    try {
-
-        // Run global prefixes.
-        for (const auto &f: before_all) {
-            if (!f()) {
-                throw fixture_exception("before_all");
-            }
-        }
-
-        // Run all tests.
-        for (const auto &t: tests) {
-
-            // Run per-test prefixes.
-            for (const auto &f: before_each) {
-                if (!f()) {
-                    throw fixture_exception("before_each");
-                }
-            }
-
-            // Run the test routine.
-            const auto r = t();
-            --results.didnt_run;
-
-            // Account for results summary.
-            switch (r.result) {
-            case stfu::test_result::DIDNT_RUN: // Not expected
-                ++results.didnt_run;
-                break;
-
-            case stfu::test_result::SKIPPED:
-                ++results.skipped;
-                break;
-
-            case stfu::test_result::PASS:
-                ++results.passed;
-                break;
+    r.result = stfu::test_result::CRASH;
 
-            case stfu::test_result::FAIL:
-                ++results.failed;
-                break;
+    const int signal = WTERMSIG(stat_loc);
 
-            case stfu::test_result::CRASH:
-                ++results.crashed;
-                break;
-            }
+    // Signalled for exceeding a limit set with setrlimit().
+    if (SIGXCPU == signal || SIGXFSZ == signal) {
+        r.result = stfu::test_result::OUT_OF_RESOURCES;
+        r.message.append("out of resources: ").append(::strsignal(signal));
+        return;
+    }
 
-            // Run per-test postfixes.
-            for (const auto &f: after_each) {
-                if (!f()) {
-                    throw fixture_exception("after_each");
-                }
-            }
+    if (signal < NSIG) {
+        r.message.append("crashed with: ")
+                 .append(::strsignal(signal));
+    }
+}
 
-            if (verbose) {
-                out << "# " << t.get_name() << ": " << std::endl;
-                wrapped_comment << t.get_description() << std::endl
-                                << std::endl;
-            }
+STFU_INLINE bool
+stfu_private::read_all(int fd, void* buf, std::size_t len) noexcept
+{
+    char* p = static_cast<char*>(buf);
 
-            out << std::setw(20) << std::left << t.get_name()
-                << r
-                << " - in " << r.runtime.count() << "s"
-                << std::endl;
+    while (len > 0) {
+        ssize_t l = ::read(fd, p, len);
 
-            if (verbose) {
-                out << std::endl;
-            }
+        if (l < 0 && EINTR == errno) {
+            continue;
         }
 
-        // Run global postfixes.
-        for (const auto &f: after_all) {
-            if (!f()) {
-                throw fixture_exception("after_all");
-            }
+        if (l < 1) {
+            return false;
         }
-    }
-
-    catch (stfu_private::fixture_exception& e) {
-        out << "# ERROR - failure in fixture: " << e.what() << std::endl;
-    }
-
-    if (verbose) {
-        std::size_t failures = results.failed + results.crashed;
 
-        out << "# Summary: " << name << " completed with " << failures
-            << ((1 == failures) ? " failure" : " failures") << std::endl;
+        p += l;
+        len -= l;
     }
 
-    return results;
+    return true;
 }
 
-inline const std::string&
-stfu_private::fail::get_message() const noexcept
+STFU_INLINE bool
+stfu_private::write_all(int fd, const void* buf, std::size_t len) noexcept
 {
-    return message;
-}
+    const char* p = static_cast<const char*>(buf);
 
-inline
-stfu_private::fail::fail() noexcept:
-    message{"FAILED"}
-{
-}
+    while (len > 0) {
+        ssize_t l = ::write(fd, p, len);
 
-inline
-stfu_private::failed_at::failed_at(const char* f, size_t l) noexcept
-{
-    message.append(" at ")
-           .append(f)
-           .append(":")
-           .append(std::to_string(l));
-}
+        if (l < 0 && EINTR == errno) {
+            continue;
+        }
 
-inline
-stfu_private::failed_assert::failed_assert(const char* f, size_t l,
-        const char* x) noexcept:
-    failed_at{f, l}
-{
-    message.append(": \"")
-           .append(x)
-           .append("\"");
-}
+        if (l < 1) {
+            return false;
+        }
 
-inline
-stfu_private::fixture_exception::fixture_exception(const char *m):
-    std::runtime_error{m}
-{
+        p += l;
+        len -= l;
+    }
+
+    return true;
 }
 
-inline
+STFU_INLINE
 stfu_private::widthbuf::widthbuf(size_t w, std::streambuf* s):
     width{w}, count{0}, sbuf{s}
 {
+    setp(area, area + sizeof(area));
+}
+
+STFU_INLINE
+stfu_private::widthbuf::~widthbuf()
+{
+    drain();
 }
 
 //
-// This is basically a line-buffering stream buffer.
+// This is basically a line-buffering stream buffer, which wraps whatever
+// is written to its put area as it's drained.
 // The algorithm is:
-// - Explicit end of line ("\r" or "\n"): we flush our buffer
-//   to the underlying stream's buffer, and set our record of
-//   the line length to 0.
-// - An "alert" character: sent to the underlying stream
-//   without recording its length, since it doesn't normally
-//   affect the appearance of the output.
+// - Explicit end of line ("\r" or "\n"): we move our buffer
+//   to the output pending for the underlying stream's buffer,
+//   and set our record of the line length to 0.
+// - An "alert" character: passed to the output without
+//   recording its length, since it doesn't normally affect the
+//   appearance of the output.
 // - tab: treated as moving to the next tab stop, which is
 //   assumed as happening every tab_width characters.
 // - Everything else: really basic buffering with word wrapping.
@@ -709,56 +7402,172 @@ stfu_private::widthbuf::widthbuf(size_t w, std::streambuf* s):
 //   buffer and break the line there. If there is no space/tab,
 //   we break the line at the limit.
 //
-inline stfu_private::widthbuf::int_type
-stfu_private::widthbuf::overflow(int_type c)
+STFU_INLINE void
+stfu_private::widthbuf::wrap(char_type c)
 {
-    if (traits_type::eq_int_type(traits_type::eof(), c)) {
-        return traits_type::not_eof(c);
-    }
-
     switch (c) {
     case '\n':
-    case '\r': {
-        buffer += static_cast<char>(c);
+    case '\r':
+        buffer += c;
         count = 0;
-        sbuf->sputn(prefix.c_str(), prefix.length());
-        int_type rc = sbuf->sputn(buffer.c_str(), buffer.size());
+        pending.append(prefix).append(buffer);
         buffer.clear();
-        return rc;
-    }
+        return;
 
     case '\a':
-        return sbuf->sputc(static_cast<char>(c));
+        pending += c;
+        return;
 
     case '\t':
-        buffer += static_cast<char>(c);
+        buffer += c;
         count += tab_width - count % tab_width;
-        return c;
+        return;
 
     default:
         if (count >= width) {
             size_t wpos = buffer.find_last_of(" \t");
             if (wpos != string::npos) {
-                sbuf->sputn(prefix.c_str(), prefix.length());
-                sbuf->sputn(buffer.c_str(), wpos);
+                pending.append(prefix).append(buffer, 0, wpos);
                 count = buffer.size()-wpos-1;
                 buffer = string(buffer, wpos+1);
             } else {
-                sbuf->sputn(prefix.c_str(), prefix.length());
-                sbuf->sputn(buffer.c_str(), buffer.size());
+                pending.append(prefix).append(buffer);
                 buffer.clear();
                 count = 0;
             }
-            sbuf->sputc('\n');
+            pending += '\n';
         }
-        buffer += static_cast<char>(c);
+        buffer += c;
         ++count;
-        return c;
     }
 }
 
-inline
+//
+// Wrap everything in the put area, and pass the completed output to the
+// underlying stream buffer in one go.
+//
+STFU_INLINE void
+stfu_private::widthbuf::drain()
+{
+    for (char_type* p = pbase(); p != pptr(); ++p) {
+        wrap(*p);
+    }
+
+    setp(area, area + sizeof(area));
+
+    if (!pending.empty()) {
+        sbuf->sputn(pending.data(), pending.size());
+        pending.clear();
+    }
+}
+
+STFU_INLINE stfu_private::widthbuf::int_type
+stfu_private::widthbuf::overflow(int_type c)
+{
+    drain();
+
+    if (!traits_type::eq_int_type(traits_type::eof(), c)) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(c);
+}
+
+//
+// Flushing only passes the output on; it's up to the owner of the
+// underlying stream to decide when that's flushed in turn.
+//
+STFU_INLINE int
+stfu_private::widthbuf::sync()
+{
+    drain();
+    return 0;
+}
+
+STFU_INLINE
 stfu_private::widthstream::widthstream(size_t width, std::ostream &os):
     std::ostream{&buf}, buf{width, os.rdbuf()}
 {
 }
+
+#endif // STFU_DEFINITIONS
+
+//
+// Counting replacements of the global operator new and delete, for exactly
+// one source file to define.
+//
+
+#if defined(STFU_COUNT_ALLOCATIONS)
+
+namespace stfu_private {
+    static const bool counting_enabled = (counting_allocations() = true);
+}
+
+void*
+operator new(std::size_t size)
+{
+    void* p = stfu_private::allocate(size);
+    if (nullptr == p) {
+        throw std::bad_alloc{};
+    }
+    return p;
+}
+
+void*
+operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void*
+operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return stfu_private::allocate(size);
+}
+
+void*
+operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return stfu_private::allocate(size);
+}
+
+void
+operator delete(void* p) noexcept
+{
+    stfu_private::deallocate(p);
+}
+
+void
+operator delete[](void* p) noexcept
+{
+    stfu_private::deallocate(p);
+}
+
+void
+operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    stfu_private::deallocate(p);
+}
+
+void
+operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    stfu_private::deallocate(p);
+}
+
+#if defined(__cpp_sized_deallocation)
+void
+operator delete(void* p, std::size_t) noexcept
+{
+    stfu_private::deallocate(p);
+}
+
+void
+operator delete[](void* p, std::size_t) noexcept
+{
+    stfu_private::deallocate(p);
+}
+#endif
+
+#endif
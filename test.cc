@@ -7,11 +7,156 @@
 
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
 #include <unistd.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
+// Count heap allocations, for the allocations unit test.
+#define STFU_COUNT_ALLOCATIONS
 #include "stfu.hh"
 
+//
+// Registered tests, for the registration unit test to select and run.
+//
+
+STFU_TAGGED_TEST(registered, first, "fast")
+{
+    STFU_PASS();
+}
+
+STFU_TAGGED_TEST(registered, second, "slow, io")
+{
+    STFU_PASS();
+}
+
+STFU_TEST(registered_failing, failing)
+{
+    STFU_FAIL();
+}
+
+//
+// Records what a group reports, for unit tests to check: each event in
+// order (G, S, R and the test's name, then E), the names of tests as they
+// start and as they're reported, and their results.
+//
+
+struct recorder: public stfu::reporter {
+    std::string events;
+    std::string started, reported;
+    std::vector<stfu::test_result_data> results;
+
+    void group_start(const stfu::test_group&) override {
+        events += "G";
+    }
+    void test_start(const stfu::test_group&, const stfu::test& t) override {
+        events += "S";
+        started += t.get_name() + " ";
+    }
+    void test_result(const stfu::test_group&, const stfu::test& t,
+                     const stfu::test_result_data& r) override {
+        events += "R" + t.get_name();
+        reported += t.get_name() + " ";
+        results.push_back(r);
+    }
+    void summary(const stfu::test_group&,
+                 const stfu::test_result_summary&) override {
+        events += "E";
+    }
+};
+
+//
+// Routine of typed tests, for the generated unit test (member templates
+// can't be declared in local classes).
+//
+
+struct sized {
+    template <typename T>
+    void operator()() const
+    {
+        STFU_PASS_IFF(sizeof(T) <= sizeof(double));
+    }
+};
+
+//
+// Routines for the zygote unit test, which can only run plain functions. The
+// marker is set after the zygote is started, so its children don't see it.
+//
+
+static int zygote_marker = 0;
+
+static void
+from_zygote()
+{
+    STFU_PASS_IFF(0 == zygote_marker);
+}
+
+static void
+noisy_zygote()
+{
+    std::cout << "from the zygote" << std::endl;
+    STFU_FAIL();
+}
+
+static void
+hung_zygote()
+{
+    for (;;) {
+        ::pause();
+    }
+}
+
+static void
+orphaning_zygote()
+{
+    // Leave a helper behind, which outlives the test.
+    if (0 == ::fork()) {
+        ::usleep(50000);
+        ::_exit(0);
+    }
+    STFU_PASS();
+}
+
+static void
+threaded_zygote()
+{
+    std::atomic<int> ran{0};
+    std::thread t{[&ran]{ ++ran; }};
+    t.join();
+    STFU_PASS_IFF(1 == ran);
+}
+
+static int zygote_fixture = 0;
+
+static void
+fixture_zygote()
+{
+    STFU_PASS_IFF(1 == zygote_fixture);
+}
+
+static stfu::arena* zygote_arena = nullptr;
+
+static void
+arena_zygote()
+{
+    STFU_PASS_IFF(nullptr != zygote_arena->data() &&
+                  7 == *static_cast<const int*>(zygote_arena->data()));
+}
+
 //
 // Self-test the STFU framework or output examples of the API.
 //
@@ -145,6 +290,7 @@ main(int argc, char* argv[])
                                 [&](){ ++fixture_out; return true; }})
                       .add_after_each(stfu::test_group::fixture{
                                 [&](){ ++fixture_out; return true; }})
+                      .set_jobs(1)
                       .set_verbose(false);
 
                 std::ostringstream output;
@@ -183,6 +329,1515 @@ main(int argc, char* argv[])
             "Verify behavior of exceptional fixtures."
     };
 
+    stfu::test parallel_jobs{"parallel jobs", []
+            {
+                using namespace std::chrono;
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                // The last test concludes first, but must report last.
+                for (int i = 0; i < 4; ++i) {
+                    std::string name = "(parallel " + std::to_string(i) + ")";
+                    nested.add_test(stfu::test{name.c_str(), [i]
+                                {
+                                    ::usleep(250000 - i * 50000);
+                                    STFU_PASS();
+                                }});
+                }
+                nested.set_jobs(4)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                auto t1 = steady_clock::now();
+                stfu::test_result_summary summary = nested(output);
+                auto t2 = steady_clock::now();
+
+                STFU_ASSERT(4 == summary.passed);
+                STFU_ASSERT(t2 - t1 < milliseconds{600});
+
+                const std::string s = output.str();
+                STFU_PASS_IFF(s.find("(parallel 0)") < s.find("(parallel 1)") &&
+                              s.find("(parallel 1)") < s.find("(parallel 2)") &&
+                              s.find("(parallel 2)") < s.find("(parallel 3)"));
+            },
+            "Verify that tests run concurrently up to the job count, and that "
+            "results are still reported in declaration order."
+    };
+
+    stfu::test jobs_config{"jobs config", []
+            {
+                ::unsetenv("STFU_JOBS");
+                STFU_ASSERT(1 == stfu::test_group{""}.get_jobs());
+
+                // Only groups which take the environment's defaults do.
+                ::setenv("STFU_JOBS", "3", 1);
+                stfu::test_group g{""};
+                STFU_ASSERT(1 == g.get_jobs());
+                STFU_ASSERT(3 == g.apply_environment().get_jobs());
+                ::unsetenv("STFU_JOBS");
+                STFU_ASSERT(5 == g.set_jobs(5).get_jobs());
+                STFU_PASS_IFF(1 <= g.set_jobs(0).get_jobs());
+            },
+            "Verify the job count defaults, environment override and "
+            "per-CPU setting."
+    };
+
+    stfu::test basic_timeout{"basic timeout", []
+            {
+                using namespace std::chrono;
+
+                stfu::test t{"", []{ ::sleep(10); STFU_PASS(); }};
+                t.set_timeout(milliseconds{100});
+
+                auto t1 = steady_clock::now();
+                auto r = t();
+                auto t2 = steady_clock::now();
+
+                STFU_ASSERT(stfu::test_result::TIMEOUT == r.result);
+                STFU_ASSERT(r.runtime >= milliseconds{100});
+                STFU_PASS_IFF(t2 - t1 < seconds{2});
+            },
+            "Verify that a test exceeding its timeout is killed and reported "
+            "as having timed out."
+    };
+
+    stfu::test group_timeout{"group timeout", []
+            {
+                using namespace std::chrono;
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"(hung)",
+                                []{ ::sleep(10); STFU_PASS(); }})
+                      .add_test(stfu::test{"(own timeout)",
+                                []{ ::usleep(300000); STFU_PASS(); }}
+                                .set_timeout(seconds{10}))
+                      .add_test(stfu::test{"(quick)", []{ STFU_PASS(); }})
+                      .set_timeout(milliseconds{100})
+                      .set_jobs(2)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                auto t1 = steady_clock::now();
+                stfu::test_result_summary summary = nested(output);
+                auto t2 = steady_clock::now();
+
+                STFU_ASSERT(1 == summary.timed_out);
+                STFU_ASSERT(2 == summary.passed);
+                STFU_ASSERT(std::string::npos != output.str().find("TIMEOUT"));
+                STFU_PASS_IFF(t2 - t1 < seconds{2});
+            },
+            "Verify that the group timeout applies to tests without their own, "
+            "and that a test's own timeout takes precedence."
+    };
+
+    stfu::test in_process{"in process", []
+            {
+                int runs = 0;
+
+                stfu::test pass{"", [&]{ ++runs; STFU_PASS(); }};
+                stfu::test fail{"", [&]{ ++runs; STFU_FAIL(); }};
+                stfu::test implicit{"", [&]{ ++runs; }};
+
+                pass.set_mode(stfu::execution_mode::IN_PROCESS);
+                fail.set_mode(stfu::execution_mode::IN_PROCESS);
+                implicit.set_mode(stfu::execution_mode::IN_PROCESS);
+
+                STFU_ASSERT(stfu::test_result::PASS == pass().result);
+                STFU_ASSERT(stfu::test_result::FAIL == fail().result);
+                STFU_ASSERT(stfu::test_result::FAIL == implicit().result);
+
+                // Side effects are visible, as no child process was used.
+                STFU_PASS_IFF(3 == runs);
+            },
+            "Verify that in-process tests keep the explicit pass/fail "
+            "protocol, and run in the calling process."
+    };
+
+    stfu::test group_mode{"group mode", []
+            {
+                int runs = 0;
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"(in process)",
+                                [&]{ ++runs; STFU_PASS(); }})
+                      .add_test(stfu::test{"(forked)",
+                                [&]{ ++runs; STFU_PASS(); }}
+                                .set_mode(stfu::execution_mode::FORKED))
+                      .set_mode(stfu::execution_mode::IN_PROCESS)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                stfu::test_result_summary summary = nested(output);
+
+                STFU_ASSERT(2 == summary.passed);
+                STFU_PASS_IFF(1 == runs);
+            },
+            "Verify that the group execution mode applies to tests which don't "
+            "choose their own."
+    };
+
+    stfu::test batched{"batched", []
+            {
+                int runs = 0;
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                // Tests share a worker, until the worker crashes.
+                nested.add_test(stfu::test{"(batched 1)",
+                                [&]{ STFU_PASS_IFF(1 == ++runs); }})
+                      .add_test(stfu::test{"(batched 2)",
+                                [&]{ STFU_PASS_IFF(2 == ++runs); }})
+                      .add_test(stfu::test{"(batched 3)",
+                                [&]{ ++runs; STFU_FAIL(); }})
+                      .add_test(stfu::test{"(crash)",
+                                [&]{ *((int*)0x1) = 1; }})
+                      .add_test(stfu::test{"(batched 4)",
+                                [&]{ STFU_PASS_IFF(1 == ++runs); }})
+                      .add_test(stfu::test{"(hung)",
+                                [&]{ ::sleep(10); }}
+                                .set_timeout(std::chrono::milliseconds{100}))
+                      .add_test(stfu::test{"(batched 5)",
+                                [&]{ STFU_PASS_IFF(1 == ++runs); }})
+                      .set_mode(stfu::execution_mode::BATCHED)
+                      .set_jobs(1)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                stfu::test_result_summary summary = nested(output);
+
+                STFU_ASSERT(4 == summary.passed);
+                STFU_ASSERT(1 == summary.failed);
+                STFU_ASSERT(1 == summary.crashed);
+                STFU_ASSERT(1 == summary.timed_out);
+                STFU_PASS_IFF(0 == runs);
+            },
+            "Verify that batched tests share a worker process, which is "
+            "replaced after a crash or timeout, with the failure attributed "
+            "to the test which was running."
+    };
+
+    stfu::test batched_parallel{"batched parallel", []
+            {
+                using namespace std::chrono;
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                for (int i = 0; i < 4; ++i) {
+                    nested.add_test(stfu::test{"(batched)", []
+                                {
+                                    ::usleep(200000);
+                                    STFU_PASS();
+                                }});
+                }
+                nested.set_mode(stfu::execution_mode::BATCHED)
+                      .set_jobs(2)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                auto t1 = steady_clock::now();
+                stfu::test_result_summary summary = nested(output);
+                auto t2 = steady_clock::now();
+
+                STFU_ASSERT(4 == summary.passed);
+                STFU_PASS_IFF(t2 - t1 < milliseconds{700});
+            },
+            "Verify that batched tests are spread across as many workers as "
+            "the job count allows."
+    };
+
+    stfu::test records{"records", []
+            {
+                // Large enough to need several reads, and to fill the pipe.
+                const std::string big(200000, 'x');
+
+                stfu::test t{"", [&]
+                    {
+                        stfu::note("first");
+                        stfu::metric("answer", 42.5);
+                        stfu::annotate("key", "value");
+                        stfu::note(big);
+                        throw stfu_private::failed_assert{"file", 1,
+                                big.c_str()};
+                    }};
+
+                for (auto m: {stfu::execution_mode::FORKED,
+                              stfu::execution_mode::IN_PROCESS}) {
+                    auto r = t.set_mode(m)();
+
+                    STFU_ASSERT(stfu::test_result::FAIL == r.result);
+                    STFU_ASSERT(r.message.size() > big.size());
+                    STFU_ASSERT(2 == r.notes.size());
+                    STFU_ASSERT("first" == r.notes[0] && big == r.notes[1]);
+                    STFU_ASSERT(1 == r.metrics.size());
+                    STFU_ASSERT("answer" == r.metrics[0].first &&
+                                42.5 == r.metrics[0].second);
+                    STFU_ASSERT(1 == r.annotations.size());
+                    STFU_ASSERT("key" == r.annotations[0].first &&
+                                "value" == r.annotations[0].second);
+                }
+
+                STFU_PASS();
+            },
+            "Verify that records of every type, and messages of any length, "
+            "are received intact from forked and in-process tests."
+    };
+
+    stfu::test records_batched{"records batched", []
+            {
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"(one)",
+                                []{ stfu::note("one"); STFU_PASS(); }})
+                      .add_test(stfu::test{"(crash)",
+                                []{ stfu::note("two"); *((int*)0x1) = 1; }})
+                      .add_test(stfu::test{"(three)",
+                                []{ stfu::note("three"); STFU_PASS(); }})
+                      .set_mode(stfu::execution_mode::BATCHED)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                stfu::test_result_summary summary = nested(output);
+                const std::string s = output.str();
+
+                STFU_ASSERT(2 == summary.passed && 1 == summary.crashed);
+                STFU_PASS_IFF(s.find("#   one") < s.find("#   two") &&
+                              s.find("#   two") < s.find("#   three"));
+            },
+            "Verify that each batched test's records are attributed to it, "
+            "including those sent before a crash."
+    };
+
+    stfu::test malformed{"malformed", []
+            {
+                // A result byte beyond the last test_result.
+                auto corrupt = []{
+                    stfu_private::emit(stfu_private::record::RESULT,
+                                       std::string(1, '\x7f'));
+                    STFU_PASS();
+                };
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"forked", corrupt})
+                      .add_test(stfu::test{"batched", corrupt}
+                                .set_mode(stfu::execution_mode::BATCHED))
+                      .add_test(stfu::test{"after", []{ STFU_PASS(); }}
+                                .set_mode(stfu::execution_mode::BATCHED));
+
+                recorder events;
+                const auto summary = nested(events);
+                const auto& r = events.results;
+
+                STFU_ASSERT(2 == summary.crashed && 1 == summary.passed);
+                STFU_ASSERT("Malformed result record" == r.at(0).message);
+                STFU_PASS_IFF("Malformed result record" == r.at(1).message);
+            },
+            "Verify that a malformed result record crashes its test, and a "
+            "batch continues in a new worker."
+    };
+
+    stfu::test capture{"capture", []
+            {
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"(quiet)",
+                                []{ std::cout << "hidden" << std::endl;
+                                    STFU_PASS(); }})
+                      .add_test(stfu::test{"(noisy)",
+                                []{ std::cout << "shown" << std::endl;
+                                    std::fprintf(stderr, "also shown\n");
+                                    STFU_FAIL(); }})
+                      .add_test(stfu::test{"(batched)",
+                                []{ std::cout << "worker" << std::endl;
+                                    *((int*)0x1) = 1; }}
+                                .set_mode(stfu::execution_mode::BATCHED))
+                      .set_capture(true)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                nested(output);
+                const std::string s = output.str();
+
+                STFU_ASSERT(std::string::npos == s.find("hidden"));
+                STFU_ASSERT(std::string::npos != s.find("# | shown"));
+                STFU_ASSERT(std::string::npos != s.find("# | also shown"));
+                STFU_PASS_IFF(std::string::npos != s.find("# | worker"));
+            },
+            "Verify that output is captured from each kind of child and only "
+            "shown for tests that did not pass."
+    };
+
+    stfu::test capture_limit{"capture limit", []
+            {
+                stfu::test_group nested{"nested", "nested tests"};
+                auto noisy = []{
+                    for (int i = 0; i < 10000; ++i) {
+                        std::cout << "line " << i << "\n";
+                    }
+                    std::cout << "last" << std::endl;
+                    STFU_FAIL();
+                };
+
+                nested.add_test(stfu::test{"(noisy)", noisy})
+                      .add_test(stfu::test{"(in process)", noisy}
+                                .set_mode(stfu::execution_mode::IN_PROCESS))
+                      .set_capture(true)
+                      .set_capture_limit(64)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                nested(output);
+                const std::string s = output.str();
+
+                STFU_ASSERT(std::string::npos == s.find("# | line 0\n"));
+                STFU_ASSERT(std::string::npos != s.find("last 64 of"));
+                STFU_PASS_IFF(s.find("# | last") != s.rfind("# | last"));
+            },
+            "Verify that only the tail of a large capture is retained."
+    };
+
+    stfu::test usage{"usage", []
+            {
+                using namespace std::chrono;
+
+                // Touch 32 MiB and spin for 50ms of CPU.
+                stfu::test t{"(busy)", []
+                    {
+                        const auto end = steady_clock::now() +
+                                         milliseconds(50);
+                        std::vector<char> memory(32 << 20);
+                        for (std::size_t i = 0; i < memory.size(); i += 4096) {
+                            memory[i] = 1;
+                        }
+                        while (steady_clock::now() < end) {
+                        }
+                        STFU_PASS_IFF(1 == memory[0]);
+                    }};
+
+                for (auto m: {stfu::execution_mode::FORKED,
+                              stfu::execution_mode::IN_PROCESS}) {
+                    const auto r = t.set_mode(m)();
+                    const auto cpu = r.usage.user + r.usage.system;
+
+                    STFU_ASSERT(stfu::test_result::PASS == r.result);
+                    STFU_ASSERT(cpu.count() >= 0.04);
+                    STFU_ASSERT(r.usage.max_rss >= 32 << 10);
+                    STFU_ASSERT(r.usage.minor_faults >= 8 << 10);
+                }
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(t)
+                      .set_mode(stfu::execution_mode::BATCHED)
+                      .set_usage(true)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                nested(output);
+
+                STFU_PASS_IFF(std::string::npos !=
+                              output.str().find("PASS - in ") &&
+                              std::string::npos !=
+                              output.str().find("s [utime "));
+            },
+            "Verify that the resources used by a test are accounted to it."
+    };
+
+    stfu::test benchmark{"benchmark", []
+            {
+                std::vector<int> values(64, 1);
+                stfu::benchmark sum{"(sum)", [values]
+                    {
+                        int total = 0;
+                        for (const auto v: values) {
+                            total += v;
+                        }
+                        stfu::do_not_optimize(total);
+                    }};
+
+                auto r = sum.set_iterations(1000).set_warmup(5)();
+                std::map<std::string, double> m(r.metrics.begin(),
+                                                r.metrics.end());
+
+                STFU_ASSERT(stfu::test_result::PASS == r.result);
+                STFU_ASSERT(1000 == m["iterations"] && 0 < m["ns/op"]);
+                STFU_ASSERT(m["ns/op min"] <= m["ns/op median"] &&
+                            m["ns/op median"] <= m["ns/op p99"]);
+
+                r = sum.set_iterations(0)
+                       .set_time_budget(stfu::test::seconds{0.05})();
+                STFU_ASSERT(stfu::test_result::PASS == r.result);
+                STFU_ASSERT(r.runtime.count() < 1.0);
+
+                stfu::benchmark broken{"(broken)", []{ STFU_FAIL(); }};
+                STFU_PASS_IFF(stfu::test_result::FAIL == broken().result);
+            },
+            "Verify that a benchmark measures its routine, within a fixed "
+            "iteration count or time budget, and reports statistics."
+    };
+
+    stfu::test phases{"phases", []
+            {
+                using namespace std::chrono;
+
+                stfu::test t{"(sleep)", []
+                    {
+                        ::usleep(50000);
+                        STFU_PASS();
+                    }};
+
+                for (auto m: {stfu::execution_mode::FORKED,
+                              stfu::execution_mode::IN_PROCESS}) {
+                    const auto r = t.set_mode(m)();
+
+                    STFU_ASSERT(r.phases.body.count() >= 0.05);
+                    STFU_ASSERT(r.phases.body <= r.runtime);
+                }
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(t.set_mode(stfu::execution_mode::BATCHED))
+                      .add_before_each([]{ ::usleep(20000); return true; })
+                      .set_phases(true)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                nested(output);
+                const std::string s = output.str();
+                const auto pos = s.find("before_each ");
+
+                STFU_ASSERT(std::string::npos != s.find("#   phases: fork "));
+                STFU_PASS_IFF(std::string::npos != pos &&
+                              std::atof(s.c_str() + pos + 12) >= 0.02);
+            },
+            "Verify that the phases of running a test are timed separately."
+    };
+
+    stfu::test budget{"budget", []
+            {
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"(fast)", []{ STFU_PASS(); }})
+                      .add_test(stfu::test{"(slow)", []
+                                { ::usleep(20000); STFU_PASS(); }}
+                                .set_budget(stfu::test::seconds{0.005}))
+                      .add_test(stfu::test{"(failing)", []
+                                { ::usleep(20000); STFU_FAIL(); }})
+                      .set_budget(stfu::test::seconds{0.01})
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                stfu::test_result_summary summary = nested(output);
+
+                STFU_ASSERT(1 == summary.passed && 1 == summary.slow);
+                STFU_PASS_IFF(1 == summary.failed &&
+                              std::string::npos != output.str().find(
+                                      "SLOW (took "));
+            },
+            "Verify that a passing test over its budget is reported as SLOW."
+    };
+
+    stfu::test baseline{"baseline", []
+            {
+                char path[] = "/tmp/stfu-baseline-XXXXXX";
+                const int fd = ::mkstemp(path);
+                STFU_ASSERT(-1 != fd);
+                ::close(fd);
+
+                auto contents = [&path]{
+                    std::ifstream in{path};
+                    return std::string{std::istreambuf_iterator<char>{in},
+                                       std::istreambuf_iterator<char>{}};
+                };
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"(sleep)", []
+                                { ::usleep(10000); STFU_PASS(); }})
+                      .set_baseline(path)
+                      .set_update_baseline(true)
+                      .set_verbose(false);
+
+                // Other groups' measures are kept when updating.
+                std::ofstream{path} << "other\t(sleep)\t1\ts\n";
+
+                std::ostringstream output;
+                stfu::test_result_summary summary = nested(output);
+                std::string s = contents();
+                const auto pos = s.find("nested\t(sleep)\t");
+
+                STFU_ASSERT(1 == summary.passed);
+                STFU_ASSERT(std::string::npos != s.find("other\t(sleep)\t1"));
+                STFU_ASSERT(std::string::npos != pos &&
+                            std::atof(s.c_str() + pos + 15) >= 0.01);
+
+                // A much faster baseline makes the same test a regression.
+                std::ofstream{path} << "nested\t(sleep)\t0.001\ts\n";
+                summary = nested.set_update_baseline(false)(output);
+                s = contents();
+                ::unlink(path);
+
+                STFU_ASSERT(1 == summary.slow);
+                STFU_PASS_IFF(std::string::npos !=
+                                      output.str().find("x baseline of") &&
+                              "nested\t(sleep)\t0.001\ts\n" == s);
+            },
+            "Verify that test performance is recorded in a baseline file, "
+            "and that a later run which regresses is reported as SLOW."
+    };
+
+    stfu::test reporter_events{"reporter events", []
+            {
+                recorder events;
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"1", []{ ::usleep(20000);
+                                                    STFU_PASS(); }})
+                      .add_test(stfu::test{"2", []{ STFU_PASS(); }})
+                      .set_jobs(2);
+
+                nested(events);
+
+                // Results arrive in declaration order, despite the first
+                // test concluding last.
+                STFU_PASS_IFF("GSSR1R2E" == events.events);
+            },
+            "Verify the sequence of events delivered to a reporter."
+    };
+
+    stfu::test reporter_formats{"reporter formats", []
+            {
+                stfu::test_group nested{"nested", "nested <tests>"};
+
+                nested.add_test(stfu::test{"(pass)", []{ STFU_PASS(); }})
+                      .add_test(stfu::test{"(fail \"quoted\")", []
+                                { stfu::metric("m", 1); STFU_FAIL(); }})
+                      .add_test(stfu::test{"(skip)", []{}}.set_enable(false));
+
+                std::ostringstream json, junit, tap;
+                nested(*std::unique_ptr<stfu::reporter>(
+                        new stfu::json_reporter{json}));
+                nested(*std::unique_ptr<stfu::reporter>(
+                        new stfu::junit_reporter{junit}));
+                nested(*std::unique_ptr<stfu::reporter>(
+                        new stfu::tap_reporter{tap}));
+
+                const std::string j = json.str(), x = junit.str(),
+                                  t = tap.str();
+
+                STFU_ASSERT(std::string::npos != j.find(
+                        "\"test\":\"(fail \\\"quoted\\\")\","
+                        "\"result\":\"FAIL\""));
+                STFU_ASSERT(std::string::npos != j.find(
+                        "\"metrics\":{\"m\":1}"));
+                STFU_ASSERT(8 == std::count(j.begin(), j.end(), '\n'));
+                STFU_ASSERT(std::string::npos != x.find(
+                        "<testsuite name=\"nested\">"));
+                STFU_ASSERT(std::string::npos != x.find(
+                        "name=\"(fail &quot;quoted&quot;)\""));
+                STFU_ASSERT(std::string::npos != x.find("<failure type"));
+                STFU_ASSERT(std::string::npos != x.find("</testsuites>"));
+                STFU_ASSERT(std::string::npos != t.find("ok 1 - (pass)"));
+                STFU_ASSERT(std::string::npos != t.find("not ok 2 - "));
+                STFU_PASS_IFF(std::string::npos != t.find("ok 3 - (skip) # SKIP") &&
+                              std::string::npos != t.find("\n1..3\n"));
+            },
+            "Verify the output of the JSON lines, JUnit XML and TAP "
+            "reporters."
+    };
+
+    stfu::test buffered_output{"buffered output", []
+            {
+                struct counting_buf: public std::stringbuf {
+                    int syncs = 0;
+                    int sync() override {
+                        ++syncs;
+                        return std::stringbuf::sync();
+                    }
+                };
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                for (int i = 0; i < 5; ++i) {
+                    nested.add_test(stfu::test{"(pass)", []{ STFU_PASS(); }});
+                }
+                nested.set_verbose(false);
+
+                // Flushed once per event by default, else only when due.
+                counting_buf each, batched;
+                std::ostream each_out{&each}, batched_out{&batched};
+                stfu::text_reporter each_report{each_out};
+                stfu::text_reporter batched_report{batched_out};
+
+                nested(each_report);
+                nested(batched_report.set_flush_interval(
+                        stfu::test::seconds{3600}));
+
+                STFU_ASSERT(7 == each.syncs && 1 == batched.syncs);
+                const std::string report = batched.str();
+                STFU_ASSERT(5 == std::count(report.begin(), report.end(),
+                                            '\n'));
+
+                // Wrapping is unaffected by buffering.
+                std::ostringstream out;
+                {
+                    stfu_private::widthstream wrapped{20, out};
+                    wrapped << "aaa bbb ccc ddd eee fff" << std::endl;
+                }
+                STFU_PASS_IFF("#   aaa bbb ccc ddd eee\n#   fff\n" ==
+                              out.str());
+            },
+            "Verify that reports are flushed per event or in batches, and "
+            "that comments are wrapped as they're buffered."
+    };
+
+    stfu::test registration{"registration", []
+            {
+                auto run = [](std::vector<const char*> args,
+                              std::string& output) {
+                    std::ostringstream out;
+
+                    // Whatever shard this runs in, run all the selected.
+                    args.insert(args.begin(), {"selftest", "--shard-index",
+                                               "0", "--shard-count", "1"});
+                    const int rc = stfu::run_main(args.size(), args.data(),
+                                                  out);
+                    output = out.str();
+                    return rc;
+                };
+
+                std::string s;
+
+                STFU_ASSERT(0 == run({"--list"}, s));
+                STFU_ASSERT(std::string::npos != s.find(
+                        "registered.first [fast]\n"
+                        "registered.second [slow, io]\n"));
+                STFU_ASSERT(std::string::npos != s.find(
+                        "registered_failing.failing\n"));
+
+                STFU_ASSERT(0 == run({"--filter", "registered.f*"}, s));
+                STFU_ASSERT(std::string::npos != s.find("first "));
+                STFU_ASSERT(std::string::npos == s.find("second "));
+
+                STFU_ASSERT(0 == run({"--tag", "io", "--list"}, s));
+                STFU_ASSERT("registered.second [slow, io]\n" == s);
+
+                STFU_ASSERT(0 == run({"--filter", "registered.*",
+                                      "--exclude-tag", "fast", "--list"}, s));
+                STFU_ASSERT("registered.second [slow, io]\n" == s);
+
+                STFU_PASS_IFF(1 == run({"--filter", "*failing*"}, s) &&
+                              std::string::npos != s.find("FAIL"));
+            },
+            "Verify that tests defined with STFU_TEST() are registered, and "
+            "selected by name and tag to run by stfu::run_main()."
+    };
+
+    stfu::test sharding{"sharding", []
+            {
+                recorder events[3];
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                for (int i = 0; i < 12; ++i) {
+                    const std::string name = "t" + std::to_string(i);
+                    stfu::test t{name.c_str(), []{ STFU_PASS(); }};
+                    nested.add_test(
+                            t.set_mode(stfu::execution_mode::IN_PROCESS));
+                }
+
+                // Every test runs in exactly one shard.
+                std::size_t count = 0;
+                std::multiset<std::string> names;
+                for (std::size_t i = 0; i < 3; ++i) {
+                    nested.set_shard(i, 3);
+                    count += nested.get_test_count();
+                    nested(events[i]);
+
+                    std::istringstream in{events[i].reported};
+                    for (std::string name; in >> name; ) {
+                        names.insert(name);
+                    }
+                }
+
+                STFU_ASSERT(12 == count && 12 == names.size());
+                for (int i = 0; i < 12; ++i) {
+                    STFU_ASSERT(1 == names.count("t" + std::to_string(i)));
+                }
+
+                // The environment's shard applies only once asked to.
+                ::setenv("STFU_SHARD_COUNT", "2", 1);
+                ::setenv("STFU_SHARD_INDEX", "1", 1);
+                stfu::test_group fresh{"nested", "nested tests"};
+                for (int i = 0; i < 12; ++i) {
+                    const std::string name = "t" + std::to_string(i);
+                    fresh.add_test(stfu::test{name.c_str(),
+                                              []{ STFU_PASS(); }});
+                }
+                const std::size_t all = fresh.get_test_count();
+                const std::size_t one = fresh.apply_environment()
+                                             .get_test_count();
+                ::unsetenv("STFU_SHARD_COUNT");
+                ::unsetenv("STFU_SHARD_INDEX");
+
+                STFU_ASSERT(12 == all &&
+                            one == nested.set_shard(1, 2).get_test_count());
+
+                // One long test outweighs the rest, given their runtimes.
+                char path[] = "/tmp/stfu-shard-XXXXXX";
+                const int fd = ::mkstemp(path);
+                STFU_ASSERT(-1 != fd);
+                ::close(fd);
+
+                {
+                    std::ofstream report{path};
+                    for (int i = 0; i < 12; ++i) {
+                        report << "{\"event\":\"test_result\","
+                                  "\"group\":\"nested\",\"test\":\"t" << i
+                               << "\",\"message\":\"\\\",\\\"runtime\\\":0\","
+                                  "\"metrics\":{\"runtime\":0},\"runtime\":"
+                               << (7 == i ? 10 : 0.1) << "}\n";
+                    }
+                    report << "{\"event\":\"test_result\","
+                              "\"group\":\"other\",\"test\":\"t1\","
+                              "\"runtime\":20}\n";
+                }
+
+                recorder weighted;
+                nested.set_shard(1, 2).set_shard_weights(path);
+                const std::size_t rest = nested.get_test_count();
+                nested.set_shard(0, 2)(weighted);
+                ::unlink(path);
+
+                STFU_PASS_IFF("t7 " == weighted.reported && 11 == rest);
+            },
+            "Verify that shards split a group's tests between them, by "
+            "name or by the runtimes in a previous report."
+    };
+
+    stfu::test fail_fast{"fail fast", []
+            {
+                bool after_all = false;
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"fail", []{ STFU_FAIL(); }})
+                      .add_test(stfu::test{"hang", []{ ::sleep(10); }})
+                      .add_test(stfu::test{"1", []{ STFU_PASS(); }})
+                      .add_test(stfu::test{"2", []{ STFU_PASS(); }})
+                      .add_after_all([&after_all]{ return after_all = true; })
+                      .set_jobs(2)
+                      .set_fail_fast();
+
+                std::ostringstream output;
+                const auto start = std::chrono::steady_clock::now();
+                const auto summary = nested(output);
+                const auto elapsed = std::chrono::steady_clock::now() - start;
+
+                STFU_ASSERT(after_all);
+                STFU_ASSERT(elapsed < std::chrono::seconds{5});
+                STFU_ASSERT(1 == summary.failed && 0 == summary.passed);
+                STFU_ASSERT(3 == summary.didnt_run);
+
+                // Run serially, the group stops at the second failure.
+                stfu::test_group serial{"serial", "serial tests"};
+
+                serial.add_test(stfu::test{"a", []{ STFU_FAIL(); }})
+                      .add_test(stfu::test{"b", []{ STFU_PASS(); }})
+                      .add_test(stfu::test{"c", []{ STFU_FAIL(); }})
+                      .add_test(stfu::test{"d", []{ STFU_PASS(); }})
+                      .set_jobs(1)
+                      .set_fail_fast(2);
+
+                const auto stopped = serial(output);
+                STFU_PASS_IFF(2 == stopped.failed && 1 == stopped.passed &&
+                              1 == stopped.didnt_run);
+            },
+            "Verify that a group stops once enough tests have failed, "
+            "killing those in flight and running its after_all fixtures."
+    };
+
+    stfu::test result_cache{"result cache", []
+            {
+                char path[] = "/tmp/stfu-cache-XXXXXX";
+                const int fd = ::mkstemp(path);
+                STFU_ASSERT(-1 != fd);
+                ::close(fd);
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"a", []{ STFU_PASS(); }})
+                      .add_test(stfu::test{"b", []{ STFU_FAIL(); }})
+                      .add_test(stfu::test{"c", []{ STFU_PASS(); }})
+                      .set_cache(path);
+
+                recorder first, failed_first, only_failed, rebuilt;
+                nested(first);
+                nested.set_failed_first(true)(failed_first);
+                nested.set_failed_first(false).set_only_failed(true)(
+                        only_failed);
+
+                // Results from another build don't excuse a rerun.
+                std::string cached;
+                {
+                    std::ifstream in{path};
+                    cached.assign(std::istreambuf_iterator<char>{in},
+                                  std::istreambuf_iterator<char>{});
+                }
+                for (std::size_t p = 0;
+                     std::string::npos != (p = cached.find("\tPASS", p));
+                     p += 5) {
+                    cached[p - 1] ^= 1;
+                }
+                std::ofstream{path} << cached;
+
+                nested(rebuilt);
+                ::unlink(path);
+
+                STFU_PASS_IFF("a b c " == first.reported &&
+                              "b a c " == failed_first.reported &&
+                              "b " == only_failed.reported &&
+                              "a b c " == rebuilt.reported);
+            },
+            "Verify that the last results of tests are cached, and used to "
+            "run earlier failures first, or alone."
+    };
+
+    stfu::test longest_first{"longest first", []
+            {
+                char path[] = "/tmp/stfu-cache-XXXXXX";
+                const int fd = ::mkstemp(path);
+                STFU_ASSERT(-1 != fd);
+                ::close(fd);
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"a", []{ ::usleep(10000); }})
+                      .add_test(stfu::test{"b", []{ STFU_PASS(); }})
+                      .add_test(stfu::test{"c", []{ ::usleep(50000); }})
+                      .set_cache(path)
+                      .set_schedule(stfu::schedule_policy::LONGEST_FIRST)
+                      .set_jobs(1);
+
+                // Without history, tests start as declared.
+                recorder first, second;
+                nested(first);
+                nested(second);
+                ::unlink(path);
+
+                STFU_PASS_IFF("a b c " == first.started &&
+                              "a b c " == first.reported &&
+                              "c a b " == second.started &&
+                              "a b c " == second.reported);
+            },
+            "Verify that tests may be started longest first, by their "
+            "cached runtimes, and still be reported in order."
+    };
+
+    stfu::test moved_tests{"moved tests", []
+            {
+                // Counts the copies made of a routine's captures.
+                struct counted {
+                    std::size_t* copies;
+
+                    explicit counted(std::size_t* c): copies{c} {}
+                    counted(const counted& c): copies{c.copies} {
+                        ++*copies;
+                    }
+                    counted(counted&&) = default;
+                };
+
+                std::size_t copies = 0;
+                const counted c{&copies};
+                stfu::test_group nested{"nested", "nested tests"};
+                stfu::test t{"moved", [c]{ STFU_PASS(); }};
+                std::function<void()> routine{[c]{ STFU_PASS(); }};
+
+                const std::size_t made = copies;
+                nested.add_test(std::move(t))
+                      .emplace_test("emplaced", std::move(routine))
+                      .set_jobs(2);
+
+                const std::size_t added = copies - made;
+
+                // Each run has its own pipe, so copies of a group (and of
+                // its tests) may run at the same time.
+                std::ostringstream output;
+                stfu::test_group copy{nested};
+                const auto a = nested(output);
+                const auto b = copy(output);
+
+                STFU_PASS_IFF(0 == added && 2 == a.passed && 2 == b.passed);
+            },
+            "Verify that tests may be moved or constructed into a group, "
+            "without copying their routines."
+    };
+
+    stfu::test arena{"arena", []
+            {
+                std::size_t setups = 0;
+                stfu::arena table{"table", 1 << 20,
+                        [&setups](void* data, std::size_t size) {
+                            auto bytes = static_cast<unsigned char*>(data);
+                            for (std::size_t i = 0; i < size; ++i) {
+                                bytes[i] = i % 251;
+                            }
+                            ++setups;
+                        }};
+                table.set_shared_size(sizeof(std::atomic<int>));
+
+                auto data = [&table] {
+                    return static_cast<const unsigned char*>(table.data());
+                };
+                auto counter = [&table] {
+                    return static_cast<std::atomic<int>*>(table.shared());
+                };
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_arena(table)
+                      .add_test(stfu::test{"read", [&] {
+                          STFU_ASSERT(table.size() == (1 << 20));
+                          STFU_ASSERT(250 == data()[250] && 0 == data()[251]);
+                          ++*counter();
+                          STFU_PASS();
+                      }})
+                      .add_test(stfu::test{"write", [&] {
+                          const_cast<unsigned char*>(data())[0] = 1;
+                          STFU_PASS();
+                      }})
+                      .set_jobs(2);
+
+                std::ostringstream output;
+                const auto first = nested(output);
+                const auto second = nested(output);
+
+                // The group set it up once; the children could read it,
+                // but not write it, and their counts are visible here.
+                STFU_PASS_IFF(1 == setups && 2 == counter()->load() &&
+                              1 == first.passed && 1 == first.crashed &&
+                              1 == second.passed && 1 == second.crashed);
+            },
+            "Verify that an arena is set up once for a group, read-only in "
+            "its children but for a section shared with the parent."
+    };
+
+    stfu::test generated{"generated", []
+            {
+                const std::vector<int> values{2, 3, 4};
+                auto even = [](int v) {
+                    stfu::metric("pid", ::getpid());
+                    STFU_PASS_IFF(0 == v % 2);
+                };
+
+                stfu::test_group nested{"nested", "nested tests"};
+                nested.add_tests(stfu::parameterized("even", values, even),
+                                 stfu::execution_mode::BATCHED)
+                      .add_tests(stfu::typed<char, double>("sized", sized{}))
+                      .set_jobs(1);
+
+                recorder events;
+                nested(events);
+
+                std::string outcomes;
+                std::set<double> pids;
+                for (const auto &r: events.results) {
+                    outcomes += stfu_private::result_name(r.result);
+                    outcomes += " ";
+                    for (const auto &m: r.metrics) {
+                        pids.insert(m.second);
+                    }
+                }
+
+                // Cases are named, and reported, one by one; the batched
+                // ones all ran in the same child.
+                STFU_PASS_IFF("even[0] even[1] even[2] sized<char> "
+                              "sized<double> " == events.reported &&
+                              "PASS FAIL PASS PASS PASS " == outcomes &&
+                              1 == pids.size());
+            },
+            "Verify that tests are generated per value and per type, and "
+            "that generated cases may be batched into one child."
+    };
+
+    stfu::test stress{"stress", []
+            {
+                auto metric = [](const stfu::test_result_data& r,
+                                 const std::string& name) {
+                    for (const auto &m: r.metrics) {
+                        if (name == m.first) {
+                            return m.second;
+                        }
+                    }
+                    return -1.0;
+                };
+
+                std::atomic<int> counter{0};
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::stress{"counts", [&counter](std::size_t) {
+                                    ++counter;
+                                }}.set_threads(4).set_iterations(1000))
+                      .add_test(stfu::stress{"fails", [](std::size_t i) {
+                                    STFU_ASSERT(2 != i);
+                                }}.set_threads(4).set_time_budget(
+                                        stfu::test::seconds{10}));
+
+                recorder events;
+                nested(events);
+
+                const auto& counts = events.results.at(0);
+                const auto& fails = events.results.at(1);
+
+                STFU_ASSERT(stfu::test_result::PASS == counts.result);
+                STFU_ASSERT(4 == metric(counts, "threads") &&
+                            4000 == metric(counts, "iterations"));
+                STFU_ASSERT(0 < metric(counts, "ops/s thread 3"));
+
+                // One failing thread fails the test, without waiting for
+                // the others' budgets.
+                STFU_PASS_IFF(stfu::test_result::FAIL == fails.result &&
+                              fails.runtime < stfu::test::seconds{5});
+            },
+            "Verify that a stress test runs its routine on many threads, "
+            "and fails if any of them does."
+    };
+
+    stfu::test suite{"suite", []
+            {
+                using namespace std::chrono;
+
+                auto nap = [] {
+                    ::usleep(200000);
+                    STFU_PASS();
+                };
+
+                auto group = [&nap](const char* name, std::size_t tests) {
+                    stfu::test_group g{name, "nested tests"};
+                    for (std::size_t i = 0; i < tests; ++i) {
+                        g.add_test(stfu::test{"nap", nap});
+                    }
+                    return g.set_jobs(tests);
+                };
+
+                auto timed = [](const stfu::test_suite& s,
+                                std::ostringstream& output,
+                                stfu::test_result_summary& summary) {
+                    const auto t1 = steady_clock::now();
+                    summary = s(output);
+                    return steady_clock::now() - t1;
+                };
+
+                stfu::test_suite small, wide;
+                small.add_group(group("a", 1))
+                     .add_group(group("b", 1))
+                     .add_group(group("c", 1))
+                     .set_jobs(3);
+                wide.add_group(group("wide", 4)).set_jobs(2);
+
+                std::ostringstream output, ignored;
+                stfu::test_result_summary summary, wide_summary;
+
+                // The groups run at once, but the group of 4 parallel tests
+                // is held to 2 at a time by the suite.
+                const auto concurrent = timed(small, output, summary);
+                const auto budgeted = timed(wide, ignored, wide_summary);
+
+                STFU_ASSERT(concurrent < milliseconds{500});
+                STFU_ASSERT(budgeted >= milliseconds{400});
+                STFU_ASSERT(3 == summary.passed && 4 == wide_summary.passed);
+                STFU_ASSERT(0 == stfu::exit_status(summary));
+
+                // Each group's report is written out whole.
+                const std::string o = output.str();
+                for (const char* g: {"a", "b", "c"}) {
+                    const auto start = o.find("group: " + std::string{g});
+                    const auto end = o.find("Summary: " + std::string{g});
+                    STFU_ASSERT(start < end && std::string::npos != end);
+                    STFU_ASSERT(std::string::npos ==
+                                o.substr(start, end - start).find("Summary"));
+                }
+
+                STFU_PASS();
+            },
+            "Verify that a suite runs its groups concurrently, within one "
+            "budget of jobs, and writes each group's report whole."
+    };
+
+    stfu::test allocations{"allocations", []
+            {
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"counted", []{
+                                    for (int i = 0; i < 3; ++i) {
+                                        delete new int{i};
+                                    }
+                                    STFU_PASS();
+                                }})
+                      .add_test(stfu::test{"free", []{
+                                    STFU_ASSERT_NO_ALLOC {
+                                        int x = 1;
+                                        stfu::do_not_optimize(x);
+                                    }
+                                    STFU_PASS();
+                                }})
+                      .add_test(stfu::test{"allocating", []{
+                                    STFU_ASSERT_NO_ALLOC {
+                                        std::vector<int> v(10);
+                                        stfu::do_not_optimize(v);
+                                    }
+                                    STFU_PASS();
+                                }});
+
+                recorder events;
+                nested(events);
+
+                const auto& counted = events.results.at(0).allocations;
+                STFU_ASSERT(3 == counted.allocations &&
+                            3 == counted.deallocations &&
+                            3 * sizeof(int) == counted.bytes);
+                STFU_ASSERT(stfu::test_result::PASS ==
+                            events.results.at(1).result);
+
+                const auto& allocating = events.results.at(2);
+                STFU_PASS_IFF(stfu::test_result::FAIL == allocating.result &&
+                              std::string::npos !=
+                              allocating.message.find("no allocation"));
+            },
+            "Verify that heap allocations are counted for each test, and "
+            "that allocation-free scopes are checked."
+    };
+
+    stfu::test counters{"counters", []
+            {
+                auto work = []{
+                    volatile unsigned long sum = 0;
+                    for (unsigned long i = 0; i < 1000000; ++i) {
+                        sum = sum + i;
+                    }
+                    STFU_PASS();
+                };
+
+                stfu::test_group counted{"counted", "counted tests"};
+                stfu::test_group uncounted{"uncounted", "uncounted tests"};
+
+                counted.add_test(stfu::test{"forked", work})
+                       .add_test(stfu::test{"in process", work}
+                                 .set_mode(stfu::execution_mode::IN_PROCESS))
+                       .set_counters(true);
+                uncounted.add_test(stfu::test{"forked", work});
+
+                recorder events, plain;
+                counted(events);
+                uncounted(plain);
+
+                // Whichever counters the system allows are counted; the rest
+                // are left out, and the tests run all the same.
+                for (const auto& r: events.results) {
+                    const auto& c = r.counters;
+                    STFU_ASSERT(stfu::test_result::PASS == r.result);
+                    STFU_ASSERT(-1 == c.task_clock || 0 < c.task_clock);
+                    STFU_ASSERT(-1 == c.instructions || 0 < c.instructions);
+                    STFU_ASSERT(-1 <= c.cycles && -1 <= c.cache_references &&
+                                -1 <= c.cache_misses &&
+                                -1 <= c.branch_misses);
+                }
+
+                const auto& c = plain.results.at(0).counters;
+                STFU_PASS_IFF(-1 == c.cycles && -1 == c.instructions &&
+                              -1 == c.task_clock);
+            },
+            "Verify that performance counters are counted only when enabled, "
+            "and left out where they aren't available."
+    };
+
+    stfu::test placement{"placement", []
+            {
+                cpu_set_t allowed;
+                CPU_ZERO(&allowed);
+                STFU_ASSERT(0 == ::sched_getaffinity(0, sizeof(allowed),
+                                                     &allowed));
+                int first = 0;
+                while (!CPU_ISSET(first, &allowed)) {
+                    ++first;
+                }
+
+                // Each child checks where it was placed.
+                auto pinned = [first]{
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    STFU_ASSERT(0 == ::sched_getaffinity(0, sizeof(set),
+                                                         &set));
+                    STFU_PASS_IFF(1 == CPU_COUNT(&set) &&
+                                  CPU_ISSET(first, &set));
+                };
+                auto single = []{
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    STFU_ASSERT(0 == ::sched_getaffinity(0, sizeof(set),
+                                                         &set));
+                    STFU_PASS_IFF(1 == CPU_COUNT(&set));
+                };
+                auto niced = []{
+                    errno = 0;
+                    STFU_PASS_IFF(5 == ::getpriority(PRIO_PROCESS, 0) &&
+                                  0 == errno);
+                };
+
+                stfu::placement group_place, nice_place, bad_place;
+                group_place.cpus.push_back(first);
+                nice_place.nice = 5;
+                bad_place.cpus.push_back(CPU_SETSIZE);
+
+                stfu::test_group placed{"placed", "placed tests"};
+                stfu::test_group spread{"spread", "spread tests"};
+
+                placed.add_test(stfu::test{"pinned", pinned})
+                      .add_test(stfu::test{"niced and pinned", pinned}
+                                .set_placement(nice_place))
+                      .add_test(stfu::test{"niced", niced}
+                                .set_placement(nice_place))
+                      .add_test(stfu::test{"misplaced", []{ STFU_PASS(); }}
+                                .set_placement(bad_place))
+                      .set_placement(group_place);
+                for (int i = 0; i < 4; ++i) {
+                    spread.add_test(stfu::test{"single", single});
+                }
+                spread.set_spread(true).set_jobs(4);
+
+                recorder events;
+                const auto summary = placed(events);
+                const auto spread_summary = spread(events);
+
+                STFU_ASSERT(4 == summary.passed);
+                STFU_ASSERT(4 == spread_summary.passed);
+
+                // What couldn't be applied is noted, without failing.
+                const auto& notes = events.results.at(3).notes;
+                STFU_PASS_IFF(1 == notes.size() &&
+                              0 == notes[0].find("couldn't pin to CPUs"));
+            },
+            "Verify that children are pinned, spread and niced as placed, "
+            "and that what can't be applied is noted."
+    };
+
+    stfu::test limits{"limits", []
+            {
+                stfu::resource_limits group_limits, cpu, memory;
+                group_limits.address_space = 1UL << 30;
+                group_limits.open_files = 16;
+                cpu.cpu_time = std::chrono::seconds{1};
+                memory.memory = 1UL << 20;
+
+                stfu::test_group limited{"limited", "limited tests"};
+
+                limited.add_test(stfu::test{"spinning", []{
+                                    for (volatile int i = 0; ; i = i + 1) {
+                                    }
+                                }}.set_limits(cpu))
+                       .add_test(stfu::test{"allocating", []{
+                                    std::vector<char> v(1UL << 31);
+                                    stfu::do_not_optimize(v);
+                                    STFU_PASS();
+                                }})
+                       .add_test(stfu::test{"opening", []{
+                                    int fd;
+                                    while (-1 != (fd = ::dup(0))) {
+                                    }
+                                    STFU_PASS_IFF(EMFILE == errno);
+                                }})
+                       .add_test(stfu::test{"uncontained", []{
+                                    STFU_PASS();
+                                }}.set_limits(memory))
+                       .set_limits(group_limits)
+                       .set_timeout(std::chrono::seconds{10})
+                       .set_jobs(4);
+
+                recorder events;
+                const auto summary = limited(events);
+                const auto& r = events.results;
+
+                STFU_ASSERT(2 == summary.out_of_resources &&
+                            2 == summary.passed);
+                STFU_ASSERT(stfu::test_result::OUT_OF_RESOURCES ==
+                            r.at(0).result);
+                STFU_ASSERT(stfu::test_result::OUT_OF_RESOURCES ==
+                            r.at(1).result);
+                STFU_ASSERT(0 == r.at(1).message.find("out of memory"));
+                STFU_ASSERT(1 == stfu::exit_status(summary));
+
+                // A memory limit needs a cgroup, which isn't set.
+                STFU_PASS_IFF(1 == r.at(3).notes.size() &&
+                              0 == r.at(3).notes[0].find(
+                                  "couldn't limit memory"));
+            },
+            "Verify that running out of CPU time or memory within limits "
+            "is reported as OUT_OF_RESOURCES, and descriptors are limited."
+    };
+
+    stfu::test comparisons{"comparisons", []
+            {
+                struct opaque {
+                    int x;
+                    bool operator!=(const opaque& o) const {
+                        return x != o.x;
+                    }
+                };
+
+                stfu::test_group compared{"compared", "compared tests"};
+
+                compared.add_test(stfu::test{"holding", []{
+                                      int evaluated = 0;
+                                      for (int i = 0; i < 1000; ++i) {
+                                          STFU_ASSERT_LT(i, 1000);
+                                          STFU_ASSERT_EQ(++evaluated, i + 1);
+                                          STFU_ASSERT_NEAR(i * 0.1, i / 10.0,
+                                                           1e-9);
+                                      }
+                                      STFU_PASS_IFF(1000 == evaluated);
+                                  }})
+                        .add_test(stfu::test{"equal", []{
+                                      const std::string word{"abc"};
+                                      STFU_ASSERT_EQ(word, std::string{"abd"});
+                                  }})
+                        .add_test(stfu::test{"near", []{
+                                      STFU_ASSERT_NEAR(0.25, 0.5, 0.125);
+                                  }})
+                        .add_test(stfu::test{"opaque", []{
+                                      STFU_ASSERT_NE(opaque{1}, opaque{1});
+                                  }})
+                        .add_test(stfu::test{"boolean", []{
+                                      STFU_ASSERT_GE(false, true);
+                                  }});
+
+                recorder events;
+                compared(events);
+                const auto& r = events.results;
+
+                STFU_ASSERT_EQ(stfu::test_result::PASS == r.at(0).result,
+                               true);
+
+                // Each failure shows the expression and both values.
+                auto shows = [&](std::size_t i, const char* text) {
+                    return stfu::test_result::FAIL == r.at(i).result &&
+                        std::string::npos != r.at(i).message.find(text);
+                };
+                STFU_ASSERT(shows(1, "\"word == std::string{\"abd\"}\" "
+                                     "with abc vs. abd"));
+                STFU_ASSERT(shows(2, "\"0.25 near 0.5\" with 0.25 vs. 0.5, "
+                                     "tolerance 0.125"));
+                STFU_ASSERT(shows(3, "with (4-byte object) vs. "
+                                     "(4-byte object)"));
+                STFU_PASS_IFF(shows(4, "with false vs. true"));
+            },
+            "Verify that comparison assertions evaluate their operands once, "
+            "and show both values when they fail."
+    };
+
+    stfu::test zygote{"zygote", []
+            {
+                recorder events;
+
+                STFU_ASSERT(stfu::start_zygote());
+                zygote_marker = 1;
+
+                // Arenas are mapped as their groups run, after the zygote.
+                stfu::arena table{"table", sizeof(int),
+                                  [](void* data, std::size_t) {
+                                      *static_cast<int*>(data) = 7;
+                                  }};
+                zygote_arena = &table;
+
+                stfu::test_group shared{"shared", "tests sharing an arena"};
+                shared.add_arena(table)
+                      .add_test(stfu::test{"arena", &arena_zygote});
+                const auto with_arena = shared(events);
+
+                // So are fixtures' effects, on the program.
+                stfu::test_group fixed{"fixed", "tests with a fixture"};
+                fixed.add_before_all([]{ zygote_fixture = 1; return true; })
+                     .add_test(stfu::test{"fixture", &fixture_zygote});
+                recorder set_up;
+                const auto with_fixture = fixed(set_up);
+
+                stfu::test_group spawned{"spawned", "spawned tests"};
+
+                spawned.add_test(stfu::test{"plain", &from_zygote})
+                       .add_test(stfu::test{"closure", []{
+                                     STFU_PASS_IFF(1 == zygote_marker);
+                                 }})
+                       .add_test(stfu::test{"noisy", &noisy_zygote})
+                       .add_test(stfu::test{"hung", &hung_zygote})
+                       .add_test(stfu::test{"orphaning", &orphaning_zygote})
+                       .add_test(stfu::test{"threaded", &threaded_zygote})
+                       .set_timeout(std::chrono::milliseconds{200})
+                       .set_capture(true)
+                       .set_jobs(2);
+
+                const auto summary = spawned(events);
+                const auto& r = events.results;
+                stfu::stop_zygote();
+
+                // What tests leave behind isn't left to this process.
+                ::usleep(100000);
+                STFU_ASSERT(-1 == ::waitpid(-1, nullptr, WNOHANG) &&
+                            ECHILD == errno);
+
+                STFU_ASSERT(1 == with_arena.passed &&
+                            1 == with_fixture.passed);
+                STFU_ASSERT(4 == summary.passed && 1 == summary.failed &&
+                            1 == summary.timed_out);
+
+                // The zygote relays each child's usage along with its exit.
+                STFU_ASSERT(0 < r.at(1).usage.max_rss);
+                STFU_ASSERT(stfu::test_result::PASS == r.at(1).result);
+                STFU_ASSERT(stfu::test_result::PASS == r.at(2).result);
+                STFU_ASSERT(std::string::npos !=
+                            r.at(3).output.find("from the zygote"));
+                STFU_PASS_IFF(stfu::test_result::TIMEOUT == r.at(4).result);
+            },
+            "Verify that plain routines run in children of the zygote, with "
+            "their output and timeouts, and closures and users of arenas "
+            "still fork."
+    };
+
+    stfu::test excluded{"excluded", []
+            {
+                const std::size_t size = 4 * ::sysconf(_SC_PAGESIZE);
+                void* const region = ::mmap(nullptr, size,
+                                            PROT_READ | PROT_WRITE,
+                                            MAP_PRIVATE | MAP_ANONYMOUS,
+                                            -1, 0);
+                STFU_ASSERT(MAP_FAILED != region);
+
+                char* const bytes = static_cast<char*>(region);
+                bytes[0] = 1;
+
+                stfu::test_group readers{"readers", "reading tests"};
+                readers.add_test(stfu::test{"reader", [bytes]{
+                                     STFU_PASS_IFF(1 == bytes[0]);
+                                 }})
+                       .set_verbose(false);
+
+                // Nothing less than a whole page can be left out.
+                STFU_ASSERT(!stfu::exclude_from_fork(bytes + 1, 4096));
+                STFU_ASSERT(stfu::exclude_from_fork(bytes, size));
+                std::ostringstream output;
+                const auto left_out = readers(output);
+
+                STFU_ASSERT(stfu::include_in_fork(bytes, size));
+                const auto put_back = readers(output);
+                ::munmap(region, size);
+
+                STFU_ASSERT(1 == left_out.crashed);
+                STFU_PASS_IFF(1 == put_back.passed);
+            },
+            "Verify that a region excluded from forks isn't mapped in test "
+            "children, until included again."
+    };
+
     //
     // Group of all the unit tests (all expected to PASS).
     //
@@ -205,6 +1860,44 @@ main(int argc, char* argv[])
                   "Anonymously defined test"})
               .add_test(fixtures)
               .add_test(fixtures_errors)
+              .add_test(parallel_jobs)
+              .add_test(jobs_config)
+              .add_test(basic_timeout)
+              .add_test(group_timeout)
+              .add_test(in_process)
+              .add_test(group_mode)
+              .add_test(batched)
+              .add_test(batched_parallel)
+              .add_test(records)
+              .add_test(records_batched)
+              .add_test(malformed)
+              .add_test(capture)
+              .add_test(capture_limit)
+              .add_test(usage)
+              .add_test(benchmark)
+              .add_test(phases)
+              .add_test(budget)
+              .add_test(baseline)
+              .add_test(reporter_events)
+              .add_test(reporter_formats)
+              .add_test(buffered_output)
+              .add_test(registration)
+              .add_test(sharding)
+              .add_test(fail_fast)
+              .add_test(result_cache)
+              .add_test(longest_first)
+              .add_test(moved_tests)
+              .add_test(arena)
+              .add_test(generated)
+              .add_test(stress)
+              .add_test(suite)
+              .add_test(allocations)
+              .add_test(counters)
+              .add_test(placement)
+              .add_test(limits)
+              .add_test(comparisons)
+              .add_test(zygote)
+              .add_test(excluded)
               .set_verbose(false);
 
     //
@@ -274,6 +1967,18 @@ main(int argc, char* argv[])
         "segmentation fault will appear as a test failure."
     };
 
+    stfu::test hung_test{"hung test", []
+        {
+            for (;;) {
+                ::pause();
+            }
+        },
+        "Demonstration of a test which never concludes. Its timeout causes it "
+        "to be killed and reported as such, instead of stalling the run."
+    };
+
+    hung_test.set_timeout(std::chrono::seconds{1});
+
     stfu::test_group examples{"examples",
         "Examples of various uses and failure conditions."};
 
@@ -287,24 +1992,116 @@ main(int argc, char* argv[])
             .add_test(pass_iff)
             .add_test(failed_assertion)
             .add_test(crash_case)
+            .add_test(hung_test)
             .set_verbose(true);
 
-    if (1 == argc) {
-        stfu::test_result_summary summary = unit_tests();
-        return static_cast<int>(summary.failed + summary.crashed);
-    }
+    // Only the top-level groups take defaults from the environment.
+    unit_tests.apply_environment();
+    examples.apply_environment();
 
-    std::string arg{argv[1]};
-    if (arg == "--examples") {
-        examples();
-        return 0;
-    }
+    bool run_examples = false;
+    std::unique_ptr<stfu::reporter> report{new stfu::text_reporter{std::cout}};
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg{argv[i]};
+
+        if (arg == "--examples") {
+            run_examples = true;
+            continue;
+        }
+
+        if (arg == "--jobs" && i + 1 < argc) {
+            std::size_t jobs = std::strtoul(argv[++i], nullptr, 10);
+            unit_tests.set_jobs(jobs);
+            examples.set_jobs(jobs);
+            continue;
+        }
 
-    std::cerr << "Usage: " << argv[0] << " [--examples]" << std::endl;
+        if (arg == "--baseline" && i + 1 < argc) {
+            unit_tests.set_baseline(argv[++i]);
+            continue;
+        }
+
+        if (arg == "--update-baseline") {
+            unit_tests.set_update_baseline(true);
+            continue;
+        }
+
+        if (arg == "--format" && i + 1 < argc) {
+            const std::string format{argv[++i]};
+
+            if (format == "json") {
+                report.reset(new stfu::json_reporter{std::cout});
+            } else if (format == "junit") {
+                report.reset(new stfu::junit_reporter{std::cout});
+            } else if (format == "tap") {
+                report.reset(new stfu::tap_reporter{std::cout});
+            } else if (format != "text") {
+                std::cerr << "Unknown format: " << format << std::endl;
+                return -1;
+            }
+            continue;
+        }
+
+        if (arg == "--shard-index" && i + 2 < argc &&
+            std::string{argv[i + 2]} == "--shard-count" && i + 3 < argc) {
+            const std::size_t index = std::strtoul(argv[i + 1], nullptr, 10);
+            const std::size_t count = std::strtoul(argv[i + 3], nullptr, 10);
+            unit_tests.set_shard(index, count);
+            examples.set_shard(index, count);
+            i += 3;
+            continue;
+        }
+
+        if (arg == "--fail-fast") {
+            unit_tests.set_fail_fast();
+            examples.set_fail_fast();
+            continue;
+        }
+
+        if (arg == "--cache" && i + 1 < argc) {
+            unit_tests.set_cache(argv[++i]);
+            continue;
+        }
+
+        if (arg == "--failed-first") {
+            unit_tests.set_failed_first(true);
+            continue;
+        }
+
+        if (arg == "--only-failed") {
+            unit_tests.set_only_failed(true);
+            continue;
+        }
+
+        if (arg == "--longest-first") {
+            unit_tests.set_schedule(stfu::schedule_policy::LONGEST_FIRST);
+            continue;
+        }
+
+        if (arg == "--shard-weights" && i + 1 < argc) {
+            unit_tests.set_shard_weights(argv[++i]);
+            examples.set_shard_weights(argv[i]);
+            continue;
+        }
+
+        std::cerr << "Usage: " << argv[0] << " [--examples] [--jobs N]"
+                  << " [--fail-fast]"
+                  << " [--cache FILE [--failed-first] [--only-failed]"
+                  << " [--longest-first]]"
+                  << " [--baseline FILE [--update-baseline]]"
+                  << " [--format text|json|junit|tap]"
+                  << " [--shard-index I --shard-count N"
+                  << " [--shard-weights REPORT]]" << std::endl;
+
+        return (arg == "--help") ? 0 : -1;
+    }
 
-    if (arg == "--help") {
+    if (run_examples) {
+        examples(*report);
         return 0;
     }
 
-    return -1;
+    stfu::test_result_summary summary = unit_tests(*report);
+    return stfu::exit_status(summary);
 }